@@ -0,0 +1,110 @@
+#ifndef CANDIDATES_H
+#define CANDIDATES_H
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QFile>
+
+/** ========================================================================
+ * @brief Candidates class remember how each brick answered to connections
+ * (attempts, successes and mean latency), saved in file
+ * ".nxt-pc-remote-control.stats", to try first the bricks that use to be
+ * on and answer faster.
+ */
+class Candidates {
+private:
+  struct Record {
+    int    attempts;
+    int    successes;
+    double latency;       // mean of successful connections (ms)
+  };
+
+  QMap<QString,Record> records;
+  QString              fileName;
+
+  /** ----------------------------------------------------------------------
+   * @brief score method estimate how good is a brick: probability of
+   * success (Laplace rule, so unknown bricks are 1/2) over expected latency.
+   */
+  double score(QString address) const {
+    Record r = records.value(address);
+    double success = (r.successes + 1.0) / (r.attempts + 2.0);
+    double latency = r.successes > 0 ? r.latency : 5000;
+    return success / (latency + 1000);
+  }
+
+public:
+
+  Candidates() : fileName(".nxt-pc-remote-control.stats") {
+    load();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief load method read lines "address attempts successes latency".
+   */
+  void load() {
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) return;
+    while (!f.atEnd()) {
+      QStringList fields = QString(f.readLine()).trimmed().split(" ");
+      if (fields.size() != 4) continue;
+      Record r;
+      r.attempts  = fields[1].toInt();
+      r.successes = fields[2].toInt();
+      r.latency   = fields[3].toDouble();
+      records.insert(fields[0], r);
+    }
+    f.close();
+  }
+
+  void save() {
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) return;
+    foreach (QString address, records.keys()) {
+      Record r = records.value(address);
+      f.write(QString("%1 %2 %3 %4\n").arg(address).arg(r.attempts)
+              .arg(r.successes).arg(r.latency, 0, 'f', 0).toLatin1());
+    }
+    f.close();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief record method keep the outcome of a connection.
+   * @param latency in ms, -1 when it failed; -2 when it was cancelled
+   * because other brick won and -3 when it was still waiting at deadline
+   * are not counted: kernel pages one brick at a time, so they tell the
+   * order of the race and not if the brick is reachable.
+   */
+  void record(QString address, int latency) {
+    if (latency < -1) return;
+    Record r = records.value(address);
+    if (!records.contains(address)) {
+      r.attempts = 0;
+      r.successes = 0;
+      r.latency = 0;
+    }
+    r.attempts++;
+    if (latency >= 0) {
+      r.latency = (r.latency*r.successes + latency) / (r.successes + 1);
+      r.successes++;
+    }
+    records.insert(address, r);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief order method sort texts beginning with a Bluetooth address (as
+   * "recents" entries), best candidates first.
+   */
+  QStringList order(QStringList texts) const {
+    for (int i=1; i<texts.size(); i++) {
+      for (int j=i; j>0 && score(texts[j].left(17)) >
+                           score(texts[j-1].left(17)); j--) {
+        texts.swap(j, j-1);
+      }
+    }
+    return texts;
+  }
+};
+
+#endif // CANDIDATES_H
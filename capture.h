@@ -0,0 +1,213 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QString>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <protocol.h>
+
+/** ========================================================================
+ * @brief Capture class keep a copy of every telegram sent to and received
+ * from brick, in a pcapng file that Wireshark can open (link type USER0,
+ * each packet is the RFCOMM payload with its direction).  Senders only copy
+ * the telegram in a lock-free ring with a monotonic timestamp; the thread
+ * of Capture writes the ring to file.  When ring is full, telegrams are
+ * dropped and counted, senders never wait.
+ */
+class Capture : public QThread {
+public:
+  enum direction { OUTGOING = 0, INCOMING = 1 };
+  enum { SLOTS = 4096 };    // power of two
+
+private:
+  struct Slot {
+    QAtomicInt sequence;
+    qint64     time;
+    byte       direction;
+    byte       size;
+    byte       bytes[MAXTELEGRAM];
+  };
+
+  Slot       ring[SLOTS];
+  QAtomicInt head;          // next slot to fill
+  int        tail;          // next slot to write (only capture thread)
+  QAtomicInt dropped;
+  QAtomicInt running;
+  FILE*      file;
+  qint64     offset;        // realtime minus monotonic (ns)
+
+  static qint64 now(clockid_t clock) {
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return (qint64)t.tv_sec*1000000000LL + t.tv_nsec;
+  }
+
+  void put16(quint16 value) { fwrite(&value, 2, 1, file); }
+  void put32(quint32 value) { fwrite(&value, 4, 1, file); }
+
+  /** ----------------------------------------------------------------------
+   * @brief header method write Section Header Block and Interface
+   * Description Block (nanosecond timestamps) of pcapng.
+   */
+  void header() {
+    put32(0x0A0D0D0A);
+    put32(28);
+    put32(0x1A2B3C4D);
+    put16(1);
+    put16(0);
+    put32(0xFFFFFFFF);          // section length unknown
+    put32(0xFFFFFFFF);
+    put32(28);
+
+    const char name[] = "nxt-rfcomm";   // 10 bytes, padded to 12
+    quint32 length = 20 + (4+12) + (4+4) + 4;
+    put32(0x00000001);
+    put32(length);
+    put16(147);                         // LINKTYPE_USER0
+    put16(0);
+    put32(0);                           // no snap length
+    put16(2);                           // if_name
+    put16(sizeof(name)-1);
+    fwrite(name, 1, sizeof(name)-1, file);
+    put16(0);
+    put16(9);                           // if_tsresol, 10^-9
+    put16(1);
+    put32(9);
+    put32(0);                           // opt_endofopt
+    put32(length);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief packet method write an Enhanced Packet Block with direction
+   * flag (1 inbound, 2 outbound).
+   */
+  void packet(const Slot& s) {
+    quint64 stamp = s.time + offset;
+    int padded = (s.size + 3) & ~3;
+    quint32 length = 32 + padded + 12;
+    put32(0x00000006);
+    put32(length);
+    put32(0);                           // interface
+    put32(stamp >> 32);
+    put32(stamp & 0xFFFFFFFF);
+    put32(s.size);
+    put32(s.size);
+    fwrite(s.bytes, 1, s.size, file);
+    static const byte zeros[4] = { 0, 0, 0, 0 };
+    fwrite(zeros, 1, padded - s.size, file);
+    put16(2);                           // epb_flags
+    put16(4);
+    put32(s.direction == INCOMING ? 1 : 2);
+    put32(0);                           // opt_endofopt
+    put32(length);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief drain method write all telegrams published in the ring.
+   * @return count of telegrams written
+   */
+  int drain() {
+    int written = 0;
+    for (;;) {
+      Slot& s = ring[tail & (SLOTS-1)];
+      if (s.sequence.loadAcquire() != tail + 1) break;
+      packet(s);
+      s.sequence.storeRelease(tail + SLOTS);
+      tail++;
+      written++;
+    }
+    if (written) fflush(file);
+    return written;
+  }
+
+protected:
+
+  /** ----------------------------------------------------------------------
+   * @brief run method write the ring to file fifty times per second, so
+   * the ring holds bursts far beyond the rate of the Bluetooth link.
+   */
+  void run() {
+    while (running.load()) {
+      if (drain() == 0) msleep(20);
+    }
+    drain();
+  }
+
+public:
+
+  Capture() : head(0), tail(0), dropped(0), running(0), file(NULL),
+              offset(0) {
+    for (int i=0; i<SLOTS; i++) ring[i].sequence.store(i);
+  }
+
+  ~Capture() {
+    stop();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief open method create the capture file and start its thread.
+   */
+  bool open(QString fileName) {
+    file = fopen(fileName.toStdString().c_str(), "wb");
+    if (!file) return false;
+    offset = now(CLOCK_REALTIME) - now(CLOCK_MONOTONIC);
+    header();
+    fflush(file);
+    running.store(1);
+    start();
+    return true;
+  }
+
+  void stop() {
+    if (!file) return;
+    running.store(0);
+    wait();
+    fclose(file);
+    file = NULL;
+  }
+
+  bool isOpen() {
+    return file != NULL;
+  }
+
+  int lost() {
+    return dropped.load();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief record method copy a telegram (length bytes included) in the
+   * ring.  It can be called from any thread at same time.
+   */
+  void record(direction way, const byte* bytes, int count) {
+    if (count > MAXTELEGRAM) count = MAXTELEGRAM;
+    qint64 time = now(CLOCK_MONOTONIC);
+    int position = head.load();
+    for (;;) {
+      Slot& s = ring[position & (SLOTS-1)];
+      int difference = s.sequence.loadAcquire() - position;
+      if (difference == 0) {
+        if (head.testAndSetRelaxed(position, position + 1)) break;
+        position = head.load();
+      }
+      else if (difference < 0) {
+        dropped.fetchAndAddRelaxed(1);
+        return;
+      }
+      else {
+        position = head.load();
+      }
+    }
+    Slot& s = ring[position & (SLOTS-1)];
+    s.time = time;
+    s.direction = way;
+    s.size = count;
+    memcpy(s.bytes, bytes, count);
+    s.sequence.storeRelease(position + 1);
+  }
+};
+
+#endif // CAPTURE_H
@@ -0,0 +1,390 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QQueue>
+#include <QFrame>
+#include <QFormLayout>
+#include <QCheckBox>
+#include <QSpinBox>
+#include <QDoubleSpinBox>
+#include <QLabel>
+#include <QTimer>
+
+#include <network.h>
+#include <idiom.h>
+
+/** ========================================================================
+ * @brief Controller class close the loop of motors A, B and C on the PC.
+ * Its thread runs at a fixed rate, with absolute deadlines; each tick it
+ * asks GETOUTPUTSTATE of every active motor and sends the power computed by
+ * PID plus feed-forward from the last rotation count received.  Requests are
+ * pipelined: a tick never waits for replies, they are taken by "replied"
+ * method from receiver thread of Network.
+ */
+class Controller : public QThread, public ReplyHandler {
+public:
+  enum { MOTORS = 3, MAXSPEED = 900 };  // degrees per second at full power
+
+private:
+  struct Motor {
+    bool        active;
+    double      target;     // degrees per second
+    double      speed;      // measured degrees per second
+    double      integral;
+    double      error;
+    qint32      count;      // last rotation count
+    qint64      at;         // arrival of last rotation count (ns)
+    int         waiting;    // GETOUTPUTSTATE without reply yet
+    signed char output;
+  };
+
+  Network*     net;
+  QMutex       lock;
+  QAtomicInt   running;
+  Motor        motors[MOTORS];
+  QQueue<byte> asked;         // ports of GETOUTPUTSTATE, in order
+  double       kp, ki, kd, kf;
+  int          rate;          // ticks per second
+  double       interval;      // mean time between ticks (ns)
+  double       deviation;     // mean distance of intervals to period (ns)
+  bool         closed;
+  bool         attached;
+
+  /** ----------------------------------------------------------------------
+   * @brief reset method clear the state of one motor.
+   */
+  void reset(Motor& m) {
+    m.active   = false;
+    m.target   = 0;
+    m.speed    = 0;
+    m.integral = 0;
+    m.error    = 0;
+    m.count    = 0;
+    m.at       = 0;
+    m.waiting  = 0;
+    m.output   = 0;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief compute method return the power for a motor after "seconds" of
+   * last tick.  Integral term is limited to avoid windup, and not kept
+   * while it is not used.
+   */
+  signed char compute(Motor& m, double seconds) {
+    double error = m.target - m.speed;
+    double derivative = seconds > 0 ? (error - m.error) / seconds : 0;
+    m.error = error;
+    m.integral += error * seconds;
+    if (ki > 0) m.integral = qBound(-100.0/ki, m.integral, 100.0/ki);
+    else m.integral = 0;
+    double out = kf*m.target + kp*error + ki*m.integral + kd*derivative;
+    return (signed char) qRound(qBound(-100.0, out, 100.0));
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief brake method stop one motor holding its position.  Lock must be
+   * taken.
+   */
+  void brake(byte port) {
+    net->directCommand(Telegram(SetOutputState(port, 0,
+                                MODE_MOTORON|MODE_BRAKE)), Network::SAFETY);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief tick method is one iteration of control loop.
+   */
+  void tick(double seconds) {
+    for (byte port=PORT_A; port<MOTORS; port++) {
+      QMutexLocker locker(&lock);
+      Motor& m = motors[port];
+      if (!m.active) continue;
+      if (m.waiting < 2 &&
+          net->request(Telegram(GetOutputState(port)), this)) {
+        m.waiting++;
+        asked.enqueue(port);
+      }
+      signed char out = compute(m, seconds);
+      if (out != m.output) {
+        m.output = out;
+        net->directCommand(Telegram(SetOutputState(port, out)));
+      }
+    }
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief engage method start or stop the thread, it runs only when the
+   * closed loop is wanted and brick is connected.
+   */
+  void engage() {
+    bool wanted = closed && attached;
+    if (wanted && !isRunning()) {
+      for (int i=0; i<MOTORS; i++) reset(motors[i]);
+      asked.clear();
+      interval = 0;
+      deviation = 0;
+      running.store(1);
+      start();
+    }
+    else if (!wanted && isRunning()) {
+      running.store(0);
+      wait();
+      net->forget(this);
+      QMutexLocker locker(&lock);
+      for (byte port=PORT_A; port<MOTORS; port++) {
+        if (motors[port].active) brake(port);
+        reset(motors[port]);
+      }
+    }
+  }
+
+protected:
+
+  /** ----------------------------------------------------------------------
+   * @brief run method wait each deadline with clock_nanosleep and keep
+   * statistics of achieved frequency and jitter, the distance of each
+   * interval between ticks to the period.  When a tick is late more than a
+   * period, deadlines are moved instead of running a burst.
+   */
+  void run() {
+    qint64 deadline = monotonic();
+    qint64 previous = deadline;
+    while (running.load()) {
+      lock.lock();
+      qint64 period = 1000000000LL / rate;
+      lock.unlock();
+
+      deadline += period;
+      struct timespec wake;
+      wake.tv_sec  = deadline / 1000000000LL;
+      wake.tv_nsec = deadline % 1000000000LL;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+
+      qint64 now = monotonic();
+      tick((now - previous) / 1e9);
+
+      lock.lock();
+      interval = interval == 0 ? now - previous :
+                 interval*0.95 + (now - previous)*0.05;
+      deviation = deviation*0.95 + qAbs(now - previous - period)*0.05;
+      lock.unlock();
+
+      previous = now;
+      if (now - deadline > period) deadline = now;
+    }
+  }
+
+public:
+
+  /** ----------------------------------------------------------------------
+   * @brief Controller constructor with gains tuned for NXT motors without
+   * load, feed-forward maps MAXSPEED to full power.
+   */
+  Controller(Network* n)
+    : net(n), running(0), kp(0.05), ki(0.2), kd(0.0), kf(100.0/MAXSPEED),
+      rate(20), interval(0), deviation(0), closed(false), attached(false) {
+    for (int i=0; i<MOTORS; i++) reset(motors[i]);
+  }
+
+  ~Controller() {
+    setAttached(false);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief replied method receive GETOUTPUTSTATE replies and estimate speed
+   * of motor with the rotation count and arrival time.  Replies come in the
+   * order of requests, also the lost ones, so "asked" tells their motor.
+   */
+  void replied(const byte* bytes, int count) {
+    OutputStateReply reply(bytes, count);
+    qint64 now = monotonic();
+    QMutexLocker locker(&lock);
+    if (asked.isEmpty()) return;
+    byte port = asked.dequeue();
+    Motor& m = motors[port];
+    if (m.waiting > 0) m.waiting--;
+    if (!reply.valid() || !reply.ok() || reply.port() != port) return;
+    if (m.at != 0 && now > m.at) {
+      double speed = (reply.rotationCount() - m.count) * 1e9 / (now - m.at);
+      m.speed = m.speed*0.5 + speed*0.5;
+    }
+    m.count = reply.rotationCount();
+    m.at = now;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setTarget method put wanted speed (degrees per second) of a
+   * motor.  Zero speed brakes the motor at once and leaves it inactive.
+   */
+  void setTarget(byte port, double speed) {
+    if (port >= MOTORS) return;
+    QMutexLocker locker(&lock);
+    Motor& m = motors[port];
+    if (speed == 0) {
+      if (m.active) brake(port);
+      m.active   = false;
+      m.target   = 0;
+      m.integral = 0;
+      m.output   = 0;
+      return;
+    }
+    m.active = true;
+    m.target = speed;
+  }
+
+  void setGains(double p, double i, double d, double f) {
+    QMutexLocker locker(&lock);
+    kp = p;
+    ki = i;
+    kd = d;
+    kf = f;
+  }
+
+  void setRate(int hz) {
+    QMutexLocker locker(&lock);
+    rate = qBound(1, hz, 200);
+  }
+
+  void setClosedLoop(bool on) {
+    closed = on;
+    engage();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setAttached method tell controller if brick is connected, it
+   * must be called before Network::unbind.
+   */
+  void setAttached(bool on) {
+    attached = on;
+    engage();
+  }
+
+  bool closedLoop()     { return closed; }
+  bool active()         { return isRunning(); }
+  int  getRate()        { return rate; }
+  double getKp()        { return kp; }
+  double getKi()        { return ki; }
+  double getKd()        { return kd; }
+  double getKf()        { return kf; }
+
+  /** ----------------------------------------------------------------------
+   * @brief frequency method return achieved ticks per second.
+   */
+  double frequency() {
+    QMutexLocker locker(&lock);
+    return interval > 0 ? 1e9 / interval : 0;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief jitter method return mean distance of intervals between ticks
+   * to the period, in milliseconds.
+   */
+  double jitter() {
+    QMutexLocker locker(&lock);
+    return deviation / 1e6;
+  }
+};
+
+/** ========================================================================
+ * @brief ControllerPanel class is the window to enable and tune Controller
+ * while robot is running.
+ */
+class ControllerPanel : public QFrame {
+  Q_OBJECT
+private:
+  Controller*     controller;
+  Idiom*          idiom;
+  QCheckBox*      closed;
+  QSpinBox*       rate;
+  QDoubleSpinBox *kp,*ki,*kd,*kf;
+  QLabel          *rateLabel,*stats;
+  QTimer*         timer;
+
+  QDoubleSpinBox* gain(double value, double step) {
+    QDoubleSpinBox* box = new QDoubleSpinBox();
+    box->setDecimals(3);
+    box->setRange(0, 10);
+    box->setSingleStep(step);
+    box->setValue(value);
+    connect(box,SIGNAL(valueChanged(double)),this,SLOT(apply()));
+    return box;
+  }
+
+public:
+
+  /** ----------------------------------------------------------------------
+   * @brief ControllerPanel constructor show current values of controller.
+   */
+  ControllerPanel(Controller* c, Idiom* i) : controller(c), idiom(i) {
+    closed    = new QCheckBox();
+    rate      = new QSpinBox();
+    rateLabel = new QLabel();
+    stats     = new QLabel();
+    timer     = new QTimer(this);
+    kp = gain(controller->getKp(), 0.01);
+    ki = gain(controller->getKi(), 0.01);
+    kd = gain(controller->getKd(), 0.001);
+    kf = gain(controller->getKf(), 0.01);
+    rate->setRange(1, 200);
+    rate->setValue(controller->getRate());
+    closed->setChecked(controller->closedLoop());
+
+    QFormLayout* layout = new QFormLayout();
+    setLayout(layout);
+    layout->addRow(closed);
+    layout->addRow(rateLabel, rate);
+    layout->addRow("Kp", kp);
+    layout->addRow("Ki", ki);
+    layout->addRow("Kd", kd);
+    layout->addRow("Kf", kf);
+    layout->addRow(stats);
+    setStyleSheet("QFrame{background-color:white}");
+    refreshIdiom();
+
+    connect(closed,SIGNAL(toggled(bool)),this,SLOT(toggle(bool)));
+    connect(rate,SIGNAL(valueChanged(int)),this,SLOT(apply()));
+    connect(timer,SIGNAL(timeout()),this,SLOT(refreshStats()));
+    timer->start(500);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief refreshIdiom method update idiom of panel.
+   */
+  void refreshIdiom() {
+    setWindowTitle(idiom->text(TXT_MENUCONTROLLER));
+    closed->setText(idiom->text(TXT_CONTROLLERCLOSEDLOOP));
+    rateLabel->setText(idiom->text(TXT_CONTROLLERRATE));
+    refreshStats();
+  }
+
+public slots:
+
+  void toggle(bool on) {
+    controller->setClosedLoop(on);
+    refreshStats();
+  }
+
+  void apply() {
+    controller->setGains(kp->value(), ki->value(), kd->value(), kf->value());
+    controller->setRate(rate->value());
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief refreshStats method show achieved frequency and jitter of the
+   * control loop.
+   */
+  void refreshStats() {
+    if (!controller->active()) {
+      stats->setText("");
+      return;
+    }
+    stats->setText(idiom->text(TXT_CONTROLLERSTATS)
+                   .arg(controller->frequency(), 0, 'f', 1)
+                   .arg(controller->jitter(), 0, 'f', 2));
+  }
+};
+
+#endif // CONTROLLER_H
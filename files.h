@@ -0,0 +1,414 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <QObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QMap>
+#include <QList>
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QFrame>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QListWidget>
+#include <QPushButton>
+#include <QLabel>
+#include <QFileDialog>
+#include <QShowEvent>
+
+#include <network.h>
+#include <idiom.h>
+
+/** ========================================================================
+ * @brief Files class list, upload and delete files of brick flash.  Lists
+ * are made with FIND FIRST and then FIND NEXT requests sent back-to-back,
+ * WINDOW of them in flight, instead of waiting each reply; uploads send
+ * WRITE requests in the same way.  Lists are kept per brick and only our
+ * own uploads and deletes discard them.  Replies are taken by "replied"
+ * method in receiver thread of Network and results are given by signals.
+ */
+class Files : public QObject, public ReplyHandler {
+  Q_OBJECT
+public:
+  struct Entry {
+    QString name;
+    quint32 size;
+  };
+  enum { WINDOW = 8, CHUNK = MAXCOMMAND - 3 };   // data bytes of a WRITE
+
+private:
+  enum task { IDLE, LISTING, UPLOADING, DELETING };
+
+  Network*                   net;
+  QMutex                     lock;
+  QMap<QString,QList<Entry> > cache;   // by address of brick
+  int                        task;
+  QString                    brick;
+  QList<Entry>               found;
+  byte                       handle;
+  bool                       opened;   // handle must be closed
+  bool                       finished;
+  int                        flying;   // requests without reply yet
+  byte                       status;   // first error
+  QByteArray                 content;  // file being uploaded
+  int                        sent;
+  qint64                     started;
+
+signals:
+
+  /** ----------------------------------------------------------------------
+   * @brief Events of operations: a list was made (with its time in ms),
+   * files of brick changed, or an operation failed (status of brick).
+   */
+  void listed(int);
+  void changed();
+  void failed(int);
+
+private:
+
+  /** ----------------------------------------------------------------------
+   * @brief send method request a telegram, in bulk lane of Network,
+   * counting it in flight.  Lock must be taken.
+   */
+  bool send(const Telegram& t) {
+    if (!net->request(t, this, Network::BULK)) return false;
+    flying++;
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief fill method keep WINDOW requests in flight while the operation
+   * is not finished.  Lock must be taken.
+   */
+  void fill() {
+    while (!finished && flying < WINDOW) {
+      if (task == LISTING) {
+        if (!send(Telegram(FindNext(handle)))) finished = true;
+      }
+      else if (sent < content.size()) {
+        int count = qMin((int)CHUNK, content.size() - sent);
+        if (!send(Telegram(Write(handle,
+                                 (const byte*)content.constData() + sent,
+                                 count)))) {
+          status = STATUS_CONNECTIONINVALID;
+          finished = true;
+        }
+        else {
+          sent += count;
+        }
+      }
+      else {
+        finished = true;
+      }
+    }
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief end method, when last reply arrived, close handle and tell the
+   * result.  Any upload or delete discards the list of brick, also when it
+   * failed: a partial file may exist or a lost reply may hide a change.
+   * Lock must be taken.
+   */
+  void end() {
+    if (!finished || flying > 0) return;
+    if (opened) {
+      net->directCommand(Telegram(Close(handle), false), Network::BULK);
+    }
+    int was = task;
+    task = IDLE;
+    opened = false;
+    content = QByteArray();
+    if (was != LISTING) cache.remove(brick);
+    if (was == LISTING && status == STATUS_SUCCESS) {
+      cache.insert(brick, found);
+      emit listed((monotonic() - started) / 1000000);
+    }
+    else if (status != STATUS_SUCCESS) {
+      emit failed(status);
+    }
+    else {
+      emit changed();
+    }
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief begin method start an operation if there is not other one.
+   * Lock must be taken.
+   */
+  bool begin(int what) {
+    if (task != IDLE || !net->connected()) return false;
+    task = what;
+    brick = net->getAddress();
+    opened = false;
+    finished = false;
+    flying = 0;
+    status = STATUS_SUCCESS;
+    started = monotonic();
+    return true;
+  }
+
+public:
+
+  Files(Network* n) : net(n), task(IDLE), handle(0), opened(false),
+                      finished(false), flying(0), status(STATUS_SUCCESS),
+                      sent(0), started(0) {
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief cached method give the list of connected brick when it is known.
+   */
+  bool cached(QList<Entry>& entries) {
+    QMutexLocker locker(&lock);
+    if (!cache.contains(net->getAddress())) return false;
+    entries = cache.value(net->getAddress());
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief list method ask all files of brick, "listed" signal is emitted
+   * at end.
+   */
+  bool list() {
+    QMutexLocker locker(&lock);
+    if (!begin(LISTING)) return false;
+    found.clear();
+    if (!send(Telegram(FindFirst("*.*")))) {
+      task = IDLE;
+      return false;
+    }
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief upload method write a local file in brick with same name.
+   */
+  bool upload(QString path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    QByteArray bytes = f.readAll();
+    f.close();
+    QByteArray name = QFileInfo(path).fileName().toLatin1();
+    QMutexLocker locker(&lock);
+    if (name.size() > FILENAMEWIDTH - 1 || !begin(UPLOADING)) return false;
+    content = bytes;
+    sent = 0;
+    if (!send(Telegram(OpenWrite(name.constData(), content.size())))) {
+      task = IDLE;
+      return false;
+    }
+    return true;
+  }
+
+  bool remove(QString name) {
+    QMutexLocker locker(&lock);
+    if (!begin(DELETING)) return false;
+    if (!send(Telegram(Delete(name.toLatin1().constData())))) {
+      task = IDLE;
+      return false;
+    }
+    return true;
+  }
+
+  bool busy() {
+    QMutexLocker locker(&lock);
+    return task != IDLE;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief reset method forget operation in progress, it must be called
+   * before Network::unbind.
+   */
+  void reset() {
+    net->forget(this);
+    QMutexLocker locker(&lock);
+    task = IDLE;
+    content = QByteArray();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief replied method advance the operation in progress with each
+   * reply.  Requests sent after the end of a list get errors, ignored.  A
+   * lost reply fails the operation, its list or file would be incomplete.
+   */
+  void replied(const byte* bytes, int count) {
+    Reply reply(bytes, count);
+    QMutexLocker locker(&lock);
+    if (flying > 0) flying--;
+    if (task == IDLE) return;
+    if (!bytes) {
+      bool listed = task == LISTING && finished;   // after end of list
+      if (!listed && status == STATUS_SUCCESS) status = STATUS_UNDEFINED;
+      finished = true;
+      end();
+      return;
+    }
+    switch (reply.command()) {
+      case OP_FINDFIRST:
+      case OP_FINDNEXT: {
+        FindReply r(bytes, count);
+        if (finished) break;
+        if (!r.valid() || !r.ok()) {
+          finished = true;
+          break;
+        }
+        Entry e;
+        e.name = QString::fromLatin1(r.filename(),
+                                     qstrnlen(r.filename(), FILENAMEWIDTH));
+        e.size = r.fileSize();
+        found.append(e);
+        if (reply.command() == OP_FINDFIRST) {
+          handle = r.handle();
+          opened = true;
+        }
+        fill();
+        break;
+      }
+      case OP_OPENWRITE: {
+        HandleReply r(bytes, count);
+        if (!r.valid(OP_OPENWRITE) || !r.ok()) {
+          status = r.status();
+          finished = true;
+          break;
+        }
+        handle = r.handle();
+        opened = true;
+        fill();
+        break;
+      }
+      case OP_WRITE: {
+        WriteReply r(bytes, count);
+        if (!r.valid() || !r.ok()) {
+          if (status == STATUS_SUCCESS) status = r.status();
+          finished = true;
+          break;
+        }
+        fill();
+        break;
+      }
+      case OP_DELETE: {
+        if (!reply.ok()) status = reply.status();
+        finished = true;
+        break;
+      }
+    }
+    end();
+  }
+};
+
+/** ========================================================================
+ * @brief FilesPanel class is the window with files of the connected brick,
+ * to upload new ones and delete them.
+ */
+class FilesPanel : public QFrame {
+  Q_OBJECT
+private:
+  Files*       files;
+  Idiom*       idiom;
+  QListWidget* list;
+  QPushButton  *refresh,*upload,*remove;
+  QLabel*      status;
+
+  void display(const QList<Files::Entry>& entries) {
+    list->clear();
+    quint32 total = 0;
+    foreach (Files::Entry e, entries) {
+      QListWidgetItem* item = new QListWidgetItem(
+                                QString("%1  (%2)").arg(e.name).arg(e.size));
+      item->setData(Qt::UserRole, e.name);
+      list->addItem(item);
+      total += e.size;
+    }
+    status->setText(idiom->text(TXT_FILESCOUNT).arg(entries.size())
+                    .arg(total));
+  }
+
+protected:
+
+  /** ----------------------------------------------------------------------
+   * @brief showEvent method show the cached list, the brick is asked only
+   * the first time.
+   */
+  void showEvent(QShowEvent*) {
+    QList<Files::Entry> entries;
+    if (files->cached(entries)) {
+      display(entries);
+    }
+    else {
+      list->clear();
+      status->setText("");
+      files->list();
+    }
+  }
+
+public:
+
+  FilesPanel(Files* f, Idiom* i) : files(f), idiom(i) {
+    list    = new QListWidget();
+    refresh = new QPushButton();
+    upload  = new QPushButton();
+    remove  = new QPushButton();
+    status  = new QLabel();
+
+    QHBoxLayout* buttons = new QHBoxLayout();
+    buttons->addWidget(refresh);
+    buttons->addWidget(upload);
+    buttons->addWidget(remove);
+    QVBoxLayout* layout = new QVBoxLayout();
+    setLayout(layout);
+    layout->addWidget(list);
+    layout->addLayout(buttons);
+    layout->addWidget(status);
+    setMinimumSize(320, 360);
+    refreshIdiom();
+
+    connect(refresh,SIGNAL(clicked()),this,SLOT(reload()));
+    connect(upload,SIGNAL(clicked()),this,SLOT(uploadFile()));
+    connect(remove,SIGNAL(clicked()),this,SLOT(removeFile()));
+    connect(files,SIGNAL(listed(int)),this,SLOT(listed(int)));
+    connect(files,SIGNAL(changed()),this,SLOT(reload()));
+    connect(files,SIGNAL(failed(int)),this,SLOT(failed(int)));
+  }
+
+  void refreshIdiom() {
+    setWindowTitle(idiom->text(TXT_MENUFILES));
+    refresh->setText(idiom->text(TXT_FILESREFRESH));
+    upload->setText(idiom->text(TXT_FILESUPLOAD));
+    remove->setText(idiom->text(TXT_FILESDELETE));
+  }
+
+public slots:
+
+  void reload() {
+    if (files->list()) status->setText("");
+  }
+
+  void uploadFile() {
+    QString path = QFileDialog::getOpenFileName(this);
+    if (!path.isEmpty()) files->upload(path);
+  }
+
+  void removeFile() {
+    QListWidgetItem* item = list->currentItem();
+    if (item) files->remove(item->data(Qt::UserRole).toString());
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief listed method show the new list and how long it took.
+   */
+  void listed(int milliseconds) {
+    QList<Files::Entry> entries;
+    if (!files->cached(entries)) return;
+    display(entries);
+    status->setText(status->text() + "  " +
+                    idiom->text(TXT_FILESTIME).arg(milliseconds));
+  }
+
+  void failed(int code) {
+    status->setText(idiom->text(TXT_FILESERROR)
+                    .arg(code, 2, 16, QChar('0')));
+  }
+};
+
+#endif // FILES_H
@@ -0,0 +1,377 @@
+#ifndef GAMEPAD_H
+#define GAMEPAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QDir>
+#include <QFrame>
+#include <QFormLayout>
+#include <QCheckBox>
+#include <QLineEdit>
+#include <QLabel>
+#include <QTimer>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include <motors.h>
+#include <steering.h>
+#include <idiom.h>
+
+/** ========================================================================
+ * @brief Gamepad class drive the robot with the sticks of a gamepad, read
+ * with evdev from "/dev/input/event*" or from a file recorded from one
+ * (e.g. "cat /dev/input/event5 > run.ev"), which is replayed with its own
+ * timing.  Left stick is an arcade drive of B and C, right stick moves A.
+ * Events only update the state of axes; at each tick of a fixed rate the
+ * sticks are quantized to steps of QUANTUM percent and motors are updated
+ * when the step changes, so noise of sticks does not reach the link.  A
+ * step changes only when the value moved half a step beyond its boundary,
+ * so a stick resting on a boundary does not toggle between two steps.
+ */
+class Gamepad : public QThread {
+public:
+  enum { RATE = 50, QUANTUM = 5, AXES = ABS_RY + 1 };
+
+private:
+  struct Axis {
+    int value, minimum, maximum, flat;
+  };
+
+  Motors*     motors;
+  QMutex      lock;
+  QAtomicInt  running;
+  QAtomicInt  lost;         // device unplugged or not opened
+  QString     path;
+  int         fd;
+  bool        replay;
+  Axis        axes[AXES];
+  signed char last[3];
+  bool        enabled;
+  bool        attached;
+  // statistics of last second
+  double      rate;
+  double      telegrams;
+
+  /** ----------------------------------------------------------------------
+   * @brief position method return an axis between -1 and 1, zero inside the
+   * flat zone of its center.
+   */
+  double position(int code) const {
+    const Axis& a = axes[code];
+    double center = (a.maximum + a.minimum) / 2.0;
+    double half = (a.maximum - a.minimum) / 2.0;
+    if (half <= 0 || qAbs(a.value - center) <= a.flat) return 0;
+    return qBound(-1.0, (a.value - center) / half, 1.0);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief tick method quantize the sticks and update the motors when the
+   * steps changed.  A step is kept only for ports Motors accepted, so a
+   * refused one (lane full, not connected) is sent again next tick.
+   * @return count of telegrams sent
+   */
+  int tick() {
+    signed char wanted[3];
+    Steering::arcade(-position(ABS_Y), position(ABS_X), -position(ABS_RY),
+                     100, wanted);
+    for (int i=0; i<3; i++) {
+      if (qAbs(wanted[i] - last[i]) < QUANTUM) {
+        wanted[i] = last[i];      // inside dead band of current step
+      }
+      else {
+        wanted[i] = (signed char) (qRound(wanted[i] / (double)QUANTUM) *
+                                   QUANTUM);
+      }
+    }
+    if (memcmp(wanted, last, 3) == 0) return 0;
+    int sent = motors->apply(wanted);
+    for (byte port=PORT_A; port<=PORT_C; port++) {
+      if (motors->setpoint(port) == wanted[port]) last[port] = wanted[port];
+    }
+    return sent;
+  }
+
+  void handle(const struct input_event& event) {
+    if (event.type == EV_ABS && event.code < AXES) {
+      axes[event.code].value = event.value;
+    }
+  }
+
+  static qint64 nanoseconds(const struct input_event& event) {
+    return (qint64)event.time.tv_sec*1000000000LL +
+           (qint64)event.time.tv_usec*1000;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief open method open the device (or recorded file) and take ranges
+   * of axes, files use the ranges of usual gamepads.
+   */
+  bool open() {
+    if (fd >= 0) ::close(fd);
+    fd = ::open(path.toStdString().c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    replay = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    for (int code=0; code<AXES; code++) {
+      struct input_absinfo range;
+      Axis& a = axes[code];
+      if (!replay && ioctl(fd, EVIOCGABS(code), &range) == 0) {
+        a.value   = range.value;
+        a.minimum = range.minimum;
+        a.maximum = range.maximum;
+        a.flat    = range.flat;
+      }
+      else {
+        a.value   = 0;
+        a.minimum = -32768;
+        a.maximum = 32767;
+        a.flat    = 4096;
+      }
+    }
+    memset(last, 0, sizeof(last));
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief engage method start or stop the thread, as Controller does.
+   */
+  void engage() {
+    bool wanted = enabled && attached;
+    if (wanted && !isRunning()) {
+      if (!open()) {
+        lost.store(1);
+        return;
+      }
+      rate = 0;
+      telegrams = 0;
+      lost.store(0);
+      running.store(1);
+      start();
+    }
+    else if (!wanted) {
+      if (isRunning()) {
+        running.store(0);
+        wait();
+      }
+      if (fd >= 0) ::close(fd);
+      fd = -1;
+    }
+  }
+
+protected:
+
+  /** ----------------------------------------------------------------------
+   * @brief run method wait events of device until next tick (ticks have
+   * absolute deadlines).  Recorded events are waited until their time.
+   */
+  void run() {
+    qint64 period = 1000000000LL / RATE;
+    qint64 begin = monotonic();
+    qint64 deadline = begin + period;
+    qint64 second = begin;
+    qint64 first = -1;        // time of first recorded event
+    int ticks = 0, sent = 0;
+    struct input_event pending;
+    bool waiting = false;     // "pending" is a recorded event not due yet
+
+    while (running.load()) {
+      qint64 now = monotonic();
+      if (replay) {
+        if (!waiting) {
+          waiting = read(fd, &pending, sizeof(pending)) == sizeof(pending);
+          if (waiting && first < 0) first = nanoseconds(pending);
+        }
+        qint64 due = waiting ? begin + nanoseconds(pending) - first
+                             : deadline;
+        if (waiting && due <= now) {
+          handle(pending);
+          waiting = false;
+          continue;
+        }
+        qint64 until = qMin(due, deadline);
+        struct timespec wake;
+        wake.tv_sec  = until / 1000000000LL;
+        wake.tv_nsec = until % 1000000000LL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+      }
+      else if (now < deadline) {
+        struct pollfd device = { fd, POLLIN, 0 };
+        struct timespec timeout;
+        timeout.tv_sec  = (deadline - now) / 1000000000LL;
+        timeout.tv_nsec = (deadline - now) % 1000000000LL;
+        if (ppoll(&device, 1, &timeout, NULL) > 0) {
+          struct input_event events[64];
+          int n = read(fd, events, sizeof(events));
+          if (n <= 0) {           // device unplugged
+            lost.store(1);
+            break;
+          }
+          for (int i=0; i<n/(int)sizeof(events[0]); i++) handle(events[i]);
+          continue;
+        }
+      }
+
+      now = monotonic();
+      if (now < deadline) continue;
+      sent += tick();
+      ticks++;
+      deadline += period;
+      if (now - deadline > period) deadline = now + period;
+      if (now - second >= 1000000000LL) {
+        QMutexLocker locker(&lock);
+        rate = ticks * 1e9 / (now - second);
+        telegrams = sent * 1e9 / (now - second);
+        ticks = sent = 0;
+        second = now;
+      }
+    }
+    motors->stop();
+  }
+
+public:
+
+  Gamepad(Motors* m)
+    : motors(m), running(0), lost(0), path(detect()), fd(-1), replay(false),
+      enabled(false), attached(false), rate(0), telegrams(0) {
+    memset(last, 0, sizeof(last));
+  }
+
+  ~Gamepad() {
+    setAttached(false);
+    if (fd >= 0) ::close(fd);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief detect method return the first joystick found by udev, or the
+   * first event device.
+   */
+  static QString detect() {
+    QStringList found = QDir("/dev/input/by-id").entryList(
+                          QStringList() << "*-event-joystick", QDir::System);
+    if (!found.isEmpty()) return "/dev/input/by-id/" + found.first();
+    return "/dev/input/event0";
+  }
+
+  void setPath(QString p) {
+    path = p;
+  }
+
+  QString getPath() {
+    return path;
+  }
+
+  void setEnabled(bool on) {
+    enabled = on;
+    lost.store(0);
+    engage();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setAttached method tell gamepad if brick is connected, it must
+   * be called before Network::unbind.
+   */
+  void setAttached(bool on) {
+    attached = on;
+    engage();
+  }
+
+  bool active() { return isRunning(); }
+
+  /** ----------------------------------------------------------------------
+   * @brief unplugged method tell if the device could not be opened or
+   * disappeared while driving; the thread has stopped then.
+   */
+  bool unplugged() { return lost.load(); }
+
+  /** ----------------------------------------------------------------------
+   * @brief frequency and throughput methods return ticks and telegrams per
+   * second achieved in the last second.
+   */
+  double frequency() {
+    QMutexLocker locker(&lock);
+    return rate;
+  }
+
+  double throughput() {
+    QMutexLocker locker(&lock);
+    return telegrams;
+  }
+};
+
+/** ========================================================================
+ * @brief GamepadPanel class is the window to choose the device of Gamepad,
+ * enable it and see its rates.
+ */
+class GamepadPanel : public QFrame {
+  Q_OBJECT
+private:
+  Gamepad*   gamepad;
+  Idiom*     idiom;
+  QCheckBox* enabled;
+  QLineEdit* device;
+  QLabel     *deviceLabel,*stats;
+  QTimer*    timer;
+
+public:
+
+  GamepadPanel(Gamepad* g, Idiom* i) : gamepad(g), idiom(i) {
+    enabled     = new QCheckBox();
+    device      = new QLineEdit();
+    deviceLabel = new QLabel();
+    stats       = new QLabel();
+    timer       = new QTimer(this);
+    device->setText(gamepad->getPath());
+
+    QFormLayout* layout = new QFormLayout();
+    setLayout(layout);
+    layout->addRow(deviceLabel, device);
+    layout->addRow(enabled);
+    layout->addRow(stats);
+    setStyleSheet("QFrame{background-color:white}");
+    refreshIdiom();
+
+    connect(enabled,SIGNAL(toggled(bool)),this,SLOT(toggle(bool)));
+    connect(timer,SIGNAL(timeout()),this,SLOT(refreshStats()));
+    timer->start(500);
+  }
+
+  void refreshIdiom() {
+    setWindowTitle(idiom->text(TXT_MENUGAMEPAD));
+    enabled->setText(idiom->text(TXT_GAMEPADENABLED));
+    deviceLabel->setText(idiom->text(TXT_GAMEPADDEVICE));
+    refreshStats();
+  }
+
+public slots:
+
+  void toggle(bool on) {
+    gamepad->setPath(device->text());
+    gamepad->setEnabled(on);
+    device->setEnabled(!on);
+    refreshStats();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief refreshStats method show ticks and telegrams per second.  When
+   * the device is lost, the gamepad is disabled and the panel tells it.
+   */
+  void refreshStats() {
+    if (enabled->isChecked() && gamepad->unplugged()) {
+      enabled->setChecked(false);
+      stats->setText(idiom->text(TXT_GAMEPADLOST));
+      return;
+    }
+    if (!gamepad->active()) {
+      if (enabled->isChecked()) stats->setText("");
+      return;
+    }
+    stats->setText(idiom->text(TXT_GAMEPADSTATS)
+                   .arg(gamepad->frequency(), 0, 'f', 1)
+                   .arg(gamepad->throughput(), 0, 'f', 1));
+  }
+};
+
+#endif // GAMEPAD_H
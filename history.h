@@ -0,0 +1,140 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <stdint.h>
+
+/** ========================================================================
+ * @brief History class keep all the samples of a session for plots, in
+ * constant memory: each channel has BUCKETS buckets with the minimum and
+ * maximum of "span" samples.  When buckets are full, pairs are merged and
+ * span is doubled, so a bucket never hides a peak.  Samples are appended
+ * by Recorder thread and read by GUI thread.
+ */
+class History {
+public:
+  enum { BUCKETS = 2048 };  // even
+
+private:
+  QMutex           lock;
+  int              channels;
+  QVector<int32_t> low, high;       // BUCKETS per channel
+  QVector<int32_t> latest;
+  QVector<qint64>  times;           // first sample of each bucket
+  int              used;
+  int              span;            // samples per bucket
+  int              filled;          // samples in last bucket
+  qint64           last;
+  int              version;
+
+  /** ----------------------------------------------------------------------
+   * @brief compact method merge pairs of buckets, all of them full.
+   */
+  void compact() {
+    for (int i=0; i<BUCKETS/2; i++) {
+      times[i] = times[2*i];
+      for (int c=0; c<channels; c++) {
+        int at = c*BUCKETS;
+        low[at+i]  = qMin(low[at+2*i],  low[at+2*i+1]);
+        high[at+i] = qMax(high[at+2*i], high[at+2*i+1]);
+      }
+    }
+    used = BUCKETS/2;
+    span *= 2;
+    filled = span;
+  }
+
+public:
+
+  History(int count)
+    : channels(count), low(count*BUCKETS), high(count*BUCKETS),
+      latest(count), times(BUCKETS), version(0) {
+    clear();
+  }
+
+  void clear() {
+    QMutexLocker locker(&lock);
+    used = 0;
+    span = 1;
+    filled = 0;
+    last = 0;
+    version++;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief append method add a sample, "values" has one per channel.
+   */
+  void append(qint64 time, const int32_t* values) {
+    QMutexLocker locker(&lock);
+    if (used == 0 || filled == span) {
+      if (used == BUCKETS) compact();
+      times[used] = time;
+      for (int c=0; c<channels; c++) {
+        low[c*BUCKETS + used] = high[c*BUCKETS + used] = values[c];
+      }
+      used++;
+      filled = 1;
+    }
+    else {
+      for (int c=0; c<channels; c++) {
+        int at = c*BUCKETS + used-1;
+        low[at]  = qMin(low[at],  values[c]);
+        high[at] = qMax(high[at], values[c]);
+      }
+      filled++;
+    }
+    for (int c=0; c<channels; c++) latest[c] = values[c];
+    last = time;
+    version++;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief changes method return a number that changes with each sample.
+   */
+  int changes() {
+    QMutexLocker locker(&lock);
+    return version;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief decimate method reduce a channel to "width" columns (fewer when
+   * there are not so many buckets) with minimum and maximum of each one.
+   * @return count of columns
+   */
+  int decimate(int channel, int width, int32_t* lows, int32_t* highs) {
+    QMutexLocker locker(&lock);
+    int columns = qMin(width, used);
+    const int32_t* l = low.constData() + channel*BUCKETS;
+    const int32_t* h = high.constData() + channel*BUCKETS;
+    for (int x=0; x<columns; x++) {
+      int first = x*used / columns;
+      int end = (x+1)*used / columns;
+      lows[x] = l[first];
+      highs[x] = h[first];
+      for (int i=first+1; i<end; i++) {
+        lows[x] = qMin(lows[x], l[i]);
+        highs[x] = qMax(highs[x], h[i]);
+      }
+    }
+    return columns;
+  }
+
+  int32_t value(int channel) {
+    QMutexLocker locker(&lock);
+    return used ? latest[channel] : 0;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief duration method return seconds between first and last sample.
+   */
+  double duration() {
+    QMutexLocker locker(&lock);
+    return used ? (last - times[0]) / 1e9 : 0;
+  }
+
+  int count() { return channels; }
+};
+
+#endif // HISTORY_H
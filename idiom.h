@@ -2,127 +2,178 @@
 #define IDIOM_H
 
 #include <QString>
+#include <QStringList>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QCoreApplication>
+#include <string.h>
 
-enum idiomtype{
-  ENG=0,SPA=1
+/** ========================================================================
+ * @brief Keys of texts, known at compile time (see idiomkeys.h).
+ */
+enum idiomkey {
+#define IDIOMKEY(name) name,
+#include <idiomkeys.h>
+#undef IDIOMKEY
+  IDIOMKEYS
 };
 
 /** ========================================================================
  * @brief The Idiom class is used to enable to "NXT PC Remote Contro" to
- * change systematically between two idioms: English and Spanish
+ * change systematically between idioms.  Each idiom is a binary catalog
+ * (built by tools/catalog.cpp) found in resources or in "languages" folder
+ * beside application, named with the first three letters of idiom.  Only
+ * the catalog in use is open, memory mapped, and texts are read directly
+ * from it by their key.
  */
 class Idiom {
-public:
-  idiomtype it;
-  QString windowTitle[2];
-  QString scanButtonLabel[2];
-  QString connectButtonLabel[2];
-  QString disconnectButtonLabel[2];
-  QString menuRecentConnections[2];
-  QString menuClearConnections[2];
-  QString menuSelectIdiom[2];
-  QString menuEnglish[2];
-  QString menuSpanish[2];
-  QString menuAbout[2];
-  QString messageSearching[2];
-  QString messageBluetoothDisabled[2];
-  QString messageNearDivices[2];
-  QString messageDeviceAvailable[2];
-  QString imageInfo[2];
-public:
+private:
+  QString      code;
+  QFile        file;
+  uchar*       mapped;
+  QByteArray   copy;    // only when catalog can not be mapped
+  const uchar* data;
+  qint64       size;
+  int          count;
+
+  quint32 u32(qint64 at) const {
+    return data[at] | (data[at+1] << 8) | (data[at+2] << 16) |
+           ((quint32)data[at+3] << 24);
+  }
 
   /** ----------------------------------------------------------------------
-   * @brief Idiom constructor launch the attributes values.  This class, has
-   * all text needed to show in application interface.
+   * @brief release method close the catalog in use.
    */
-  Idiom() : it(ENG) {
-    windowTitle[ENG] = "NXT PC Remote Control";
-    windowTitle[SPA] = "Control Remoto de PC para NXT";
-
-    scanButtonLabel[ENG] = "Scan";
-    scanButtonLabel[SPA] = "Buscar";
-
-    connectButtonLabel[ENG] = "Connect";
-    connectButtonLabel[SPA] = "Conectar";
-
-    disconnectButtonLabel[ENG] = "Disconnect";
-    disconnectButtonLabel[SPA] = "Desconectar";
-
-    menuRecentConnections[ENG] = "Recent connections";
-    menuRecentConnections[SPA] = "Conexiones Recientes";
-
-    menuClearConnections[ENG] = "Clean connections";
-    menuClearConnections[SPA] = "Limpiar conexiones";
-
-    menuSelectIdiom[ENG] = "Switch language";
-    menuSelectIdiom[SPA] = "Cambiar idioma";
-
-    menuEnglish[ENG] = "English";
-    menuEnglish[SPA] = "Ingles";
+  void release() {
+    if (mapped) file.unmap(mapped);
+    if (file.isOpen()) file.close();
+    copy = QByteArray();
+    mapped = NULL;
+    data = NULL;
+    size = 0;
+    count = 0;
+  }
 
-    menuSpanish[ENG] = "Spanish";
-    menuSpanish[SPA] = "Espanol";
+  /** ----------------------------------------------------------------------
+   * @brief load method open and check the catalog of "path".  Catalogs in
+   * resources are stored without compression (resources.qrc) so they are
+   * mapped too; a compressed resource would be read once.
+   */
+  bool load(QString path) {
+    release();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    size = file.size();
+    mapped = file.map(0, size);
+    if (mapped) {
+      data = mapped;
+    }
+    else {
+      copy = file.readAll();
+      file.close();
+      data = (const uchar*)copy.constData();
+      size = copy.size();
+    }
+    if (size < 8 || memcmp(data, "NXTL", 4) != 0 || data[4] != 1 ||
+        size < 8 + 4*(qint64)(data[6] | (data[7] << 8))) {
+      release();
+      return false;
+    }
+    count = data[6] | (data[7] << 8);
+    return true;
+  }
 
-    menuAbout[ENG] = "About (Ver.0-34)";
-    menuAbout[SPA] = "Acerca de (Ver.0-34)";
+  /** ----------------------------------------------------------------------
+   * @brief path method return where is the catalog of an idiom, a file in
+   * "languages" folder replaces the one in resources.
+   */
+  static QString path(QString idiom) {
+    QString local = QCoreApplication::applicationDirPath() +
+                    "/languages/" + idiom + ".cat";
+    if (QFile::exists(local)) return local;
+    return ":/languages/" + idiom + ".cat";
+  }
 
-    messageSearching[ENG] = "Searching to devices...";
-    messageSearching[SPA] = "Buscando Dispositivos...";
+public:
 
-    messageBluetoothDisabled[ENG] = "Bluetooth disabled";
-    messageBluetoothDisabled[SPA] = "Bluetooth deshabilitado";
+  /** ----------------------------------------------------------------------
+   * @brief Idiom constructor open the catalog of an idiom, English by
+   * default.
+   */
+  Idiom(QString idiom = "eng")
+    : mapped(NULL), data(NULL), size(0), count(0) {
+    setIdiom(idiom);
+  }
 
-    messageNearDivices[ENG] = "There isn't near devices";
-    messageNearDivices[SPA] = "No hay dispositivos cercanos";
+  ~Idiom() {
+    release();
+  }
 
-    messageDeviceAvailable[ENG] = "Device isn't available";
-    messageDeviceAvailable[SPA] = "El dispositivo ya no esta disponible";
+  /** ----------------------------------------------------------------------
+   * @brief available method return the idioms (first three letters) with
+   * catalog.
+   */
+  static QStringList available() {
+    QStringList idioms;
+    QStringList folders;
+    folders << ":/languages"
+            << QCoreApplication::applicationDirPath() + "/languages";
+    foreach (QString folder, folders) {
+      QStringList files = QDir(folder).entryList(QStringList() << "*.cat",
+                                                 QDir::Files, QDir::Name);
+      foreach (QString name, files) {
+        QString idiom = QFileInfo(name).baseName();
+        if (!idioms.contains(idiom)) idioms.append(idiom);
+      }
+    }
+    return idioms;
+  }
 
-    imageInfo[ENG] = ":/images/info-eng.png";
-    imageInfo[SPA] = ":/images/info-spa.png";
+  /** ----------------------------------------------------------------------
+   * @brief nativeName method return the name of an idiom written in the
+   * same idiom, e.g. "Español".
+   */
+  static QString nativeName(QString idiom) {
+    QString name = Idiom(idiom).text(TXT_LANGUAGE);
+    return name.isEmpty() ? idiom : name;
   }
 
   /** ----------------------------------------------------------------------
-   * @brief getText method return the current set idiom
-   * @return first three letters of idom
+   * @brief setIdiom method, put a new selected idiom, the previous catalog
+   * is closed.  When catalog is missing or broken, idiom does not change.
+   * @param first three letters of idiom
    */
-  QString getText() {
-    switch (it) {
-    case ENG: return "eng";
-    case SPA: return "spa";
+  bool setIdiom(QString idiom) {
+    if (idiom == code && data) return true;
+    QString previous = code;
+    if (load(path(idiom))) {
+      code = idiom;
+      return true;
     }
+    if (!previous.isEmpty()) load(path(previous));
+    return false;
   }
 
   /** ----------------------------------------------------------------------
-   * @brief setIdiomType method, put a new selected idiom
-   * @param new idiom (of idiomtype)
+   * @brief getIdiom method return the current set idiom
+   * @return first three letters of idom
    */
-  void setIdiomType(idiomtype newit)  {
-    it = newit;
+  QString getIdiom() const {
+    return code;
   }
 
   /** ----------------------------------------------------------------------
-   * @brief the next methods return all attributes values, namely,
-   * this methods return de messages in current idiom.
+   * @brief text method return a text in current idiom.  Texts missing in
+   * catalog (older than application) are empty.
    */
-
-  idiomtype getIdiomType()              { return it; }
-
-  QString getWindowTitle()              { return windowTitle[it]; }
-  QString getScanButtonLabel()          { return scanButtonLabel[it]; }
-  QString getConnectButtonLabel()       { return connectButtonLabel[it]; }
-  QString getDisconnectButtonLabel()    { return disconnectButtonLabel[it]; }
-  QString getMenuRecentConnections()    { return menuRecentConnections[it]; }
-  QString getMenuClearConnections()     { return menuClearConnections[it]; }
-  QString getMenuSelectIdiom()          { return menuSelectIdiom[it]; }
-  QString getMenuEnglish()              { return menuEnglish[it]; }
-  QString getMenuSpanish()              { return menuSpanish[it]; }
-  QString getMenuAbout()                { return menuAbout[it]; }
-  QString getMessageSearching()         { return messageSearching[it]; }
-  QString getMessageBluetoothDisabled() { return messageBluetoothDisabled[it]; }
-  QString getMessageNearDivices()       { return messageNearDivices[it]; }
-  QString getMessageDeviceAvailable()   { return messageDeviceAvailable[it]; }
-  QString getImageInfo()                { return imageInfo[it]; }
+  QString text(idiomkey key) const {
+    if (key >= count) return QString();
+    quint32 at = u32(8 + 4*key);
+    if (at >= size) return QString();
+    int length = qstrnlen((const char*)data + at, size - at);
+    return QString::fromUtf8((const char*)data + at, length);
+  }
 };
 
 #endif // IDIOM_H
@@ -0,0 +1,53 @@
+/** ========================================================================
+ * @brief Keys of all texts shown by NXT PC Remote Control.  Catalogs keep
+ * their strings in this order, so new keys must be added at the end and
+ * catalogs rebuilt with tools/catalog.cpp.  This file is included several
+ * times, with IDIOMKEY defined as needed.
+ */
+IDIOMKEY(TXT_LANGUAGE)
+IDIOMKEY(TXT_WINDOWTITLE)
+IDIOMKEY(TXT_SCANBUTTON)
+IDIOMKEY(TXT_CONNECTBUTTON)
+IDIOMKEY(TXT_DISCONNECTBUTTON)
+IDIOMKEY(TXT_MENURECENTCONNECTIONS)
+IDIOMKEY(TXT_MENUCLEARCONNECTIONS)
+IDIOMKEY(TXT_MENUSELECTIDIOM)
+IDIOMKEY(TXT_MENUABOUT)
+IDIOMKEY(TXT_MESSAGESEARCHING)
+IDIOMKEY(TXT_MESSAGEBLUETOOTHDISABLED)
+IDIOMKEY(TXT_MESSAGENEARDEVICES)
+IDIOMKEY(TXT_MESSAGEDEVICEAVAILABLE)
+IDIOMKEY(TXT_IMAGEINFO)
+IDIOMKEY(TXT_MENUCONTROLLER)
+IDIOMKEY(TXT_CONTROLLERCLOSEDLOOP)
+IDIOMKEY(TXT_CONTROLLERRATE)
+IDIOMKEY(TXT_CONTROLLERSTATS)
+IDIOMKEY(TXT_MENURACE)
+IDIOMKEY(TXT_MENURECORD)
+IDIOMKEY(TXT_MENUSTOPRECORD)
+IDIOMKEY(TXT_MENUPLOTS)
+IDIOMKEY(TXT_MENUGAMEPAD)
+IDIOMKEY(TXT_GAMEPADENABLED)
+IDIOMKEY(TXT_GAMEPADDEVICE)
+IDIOMKEY(TXT_GAMEPADSTATS)
+IDIOMKEY(TXT_MENUFILES)
+IDIOMKEY(TXT_FILESREFRESH)
+IDIOMKEY(TXT_FILESUPLOAD)
+IDIOMKEY(TXT_FILESDELETE)
+IDIOMKEY(TXT_FILESCOUNT)
+IDIOMKEY(TXT_FILESTIME)
+IDIOMKEY(TXT_FILESERROR)
+IDIOMKEY(TXT_MENUMELODY)
+IDIOMKEY(TXT_MELODYOPEN)
+IDIOMKEY(TXT_MELODYPLAY)
+IDIOMKEY(TXT_MELODYSTOP)
+IDIOMKEY(TXT_MELODYSCORE)
+IDIOMKEY(TXT_MELODYUNREADABLE)
+IDIOMKEY(TXT_MELODYNOTE)
+IDIOMKEY(TXT_MELODYSUMMARY)
+IDIOMKEY(TXT_MENUSHARED)
+IDIOMKEY(TXT_SHAREDENABLED)
+IDIOMKEY(TXT_SHAREDSTATS)
+IDIOMKEY(TXT_SHAREDERROR)
+IDIOMKEY(TXT_GAMEPADLOST)
+IDIOMKEY(TXT_SHAREDBUSY)
@@ -1,12 +1,35 @@
 #include <QApplication>
 #include <window.h>
+#include <relay.h>
 
 /** ========================================================================
- * @brief This es the starting point of NXT PC Remote Control
+ * @brief This es the starting point of NXT PC Remote Control.  With
+ * "--relay MAC [PORT] [SOCKET]" it runs without GUI, sharing the brick with
+ * local clients (see relay.h); MAC can be the Unix socket of a stand-in.
+ * Before them, "--capture FILE" records all traffic with brick in a pcapng
+ * file (see capture.h).
  */
 int main(int argCount,char* argValues[]) {
+  Capture capture;
+  if (argCount >= 3 && strcmp(argValues[1],"--capture") == 0) {
+    if (!capture.open(argValues[2])) {
+      perror("opening capture file");
+      return 1;
+    }
+    argValues[2] = argValues[0];
+    argValues += 2;
+    argCount -= 2;
+  }
+  if (argCount >= 3 && strcmp(argValues[1],"--relay") == 0) {
+    Relay relay;
+    relay.setCapture(capture.isOpen() ? &capture : NULL);
+    return relay.exec(argValues[2],
+                      argCount >= 4 ? atoi(argValues[3]) : Relay::RELAYPORT,
+                      argCount >= 5 ? argValues[4] : "");
+  }
   QApplication app(argCount,argValues);
   Window w;
+  w.setCapture(capture.isOpen() ? &capture : NULL);
   w.show();
   return app.exec();
 }
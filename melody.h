@@ -0,0 +1,632 @@
+#ifndef MELODY_H
+#define MELODY_H
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QQueue>
+#include <QVector>
+#include <QList>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QFrame>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QListWidget>
+#include <QPushButton>
+#include <QLabel>
+#include <QTimer>
+#include <QFileDialog>
+#include <math.h>
+
+#include <network.h>
+#include <idiom.h>
+
+/** ========================================================================
+ * @brief Note of a melody: when it starts (ms since the beginning), its
+ * frequency and how long it sounds.  Rests are the gaps between notes.
+ */
+struct Note {
+  quint32  start;
+  uint16_t frequency;
+  uint16_t duration;
+};
+
+/** ========================================================================
+ * @brief Score class read melodies from two formats:
+ *
+ * Text scores, tokens separated by spaces, "#" until end of line is a
+ * comment.  "T120" sets the tempo in quarter notes per minute.  A note is
+ * its letter, an optional "#" or "b", the octave (4 when absent) and the
+ * length after "/" (4 is a quarter, 8 an eighth...), "." makes it dotted:
+ * "T140 E5/8 D#5/8 E5/8 R/8 B4/4.".  "R" is a rest.
+ *
+ * Standard MIDI files (format 0 or 1), only the first track with notes is
+ * played and it is made monophonic: a new note cuts the one sounding.
+ */
+class Score {
+public:
+  enum { MINFREQUENCY = 200, MAXFREQUENCY = 14000 };   // of brick
+
+  /** ----------------------------------------------------------------------
+   * @brief frequency method of a MIDI key (69 is A4, 440 Hz), inside the
+   * range of brick.
+   */
+  static uint16_t frequency(int key) {
+    double hz = 440.0 * pow(2.0, (key - 69) / 12.0);
+    return (uint16_t) qBound((double)MINFREQUENCY, hz + 0.5,
+                             (double)MAXFREQUENCY);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief add method append a note that sounds 7/8 of its length, so
+   * repeated notes are heard apart.
+   */
+  static void add(QList<Note>& notes, int key, double start, double length) {
+    Note n;
+    n.start     = (quint32) (start + 0.5);
+    n.frequency = frequency(key);
+    n.duration  = (uint16_t) qBound(1.0, length * 7 / 8, 65535.0);
+    notes.append(n);
+  }
+
+  static bool parseText(const QByteArray& text, QList<Note>& notes) {
+    static const int semitones[7] = { 9, 11, 0, 2, 4, 5, 7 };   // A..G
+    double tempo = 120, time = 0;
+    notes.clear();
+    foreach (QByteArray line, text.split('\n')) {
+      int comment = line.indexOf('#', 0);
+      // "#" after a letter is a sharp, a comment starts a word
+      while (comment > 0 && line[comment-1] != ' ' &&
+             line[comment-1] != '\t') {
+        comment = line.indexOf('#', comment + 1);
+      }
+      if (comment >= 0) line.truncate(comment);
+      foreach (QByteArray word, line.simplified().split(' ')) {
+        if (word.isEmpty()) continue;
+        char head = word[0] & ~0x20;    // upper case
+        bool ok = true;
+        if (head == 'T') {
+          tempo = word.mid(1).toDouble(&ok);
+          if (!ok || tempo <= 0) return false;
+          continue;
+        }
+        int at = 1, key = -1;
+        if (head >= 'A' && head <= 'G') {
+          int semitone = semitones[head - 'A'];
+          if (at < word.size() && word[at] == '#') { semitone++; at++; }
+          else if (at < word.size() && word[at] == 'b') { semitone--; at++; }
+          int octave = 4;
+          if (at < word.size() && word[at] >= '0' && word[at] <= '9') {
+            octave = word[at++] - '0';
+          }
+          key = 12*(octave + 1) + semitone;
+        }
+        else if (head != 'R') {
+          return false;
+        }
+        double length = 4;
+        bool dotted = word.endsWith('.');
+        if (dotted) word.chop(1);
+        if (at < word.size()) {
+          if (word[at] != '/') return false;
+          length = word.mid(at + 1).toDouble(&ok);
+          if (!ok || length <= 0) return false;
+        }
+        double ms = 60000.0 / tempo * 4 / length * (dotted ? 1.5 : 1);
+        if (key >= 0) add(notes, key, time, ms);
+        time += ms;
+      }
+    }
+    return !notes.isEmpty();
+  }
+
+private:
+
+  /** ----------------------------------------------------------------------
+   * @brief Reader of MIDI bytes, reading out of the end gives zeros and
+   * clears "ok".
+   */
+  struct Bytes {
+    const byte* data;
+    int         size;
+    int         at;
+    bool        ok;
+    Bytes(const byte* d, int n) : data(d), size(n), at(0), ok(true) {}
+    bool more() const { return ok && at < size; }
+    byte u8() {
+      if (at >= size) { ok = false; return 0; }
+      return data[at++];
+    }
+    quint32 u16() { quint32 v = u8() << 8; return v | u8(); }
+    quint32 u32() { quint32 v = u16() << 16; return v | u16(); }
+    quint32 vlq() {
+      quint32 v = 0;
+      for (int i=0; i<4; i++) {
+        byte b = u8();
+        v = (v << 7) | (b & 0x7F);
+        if (!(b & 0x80)) break;
+      }
+      return v;
+    }
+    void skip(quint32 n) {
+      if (n > (quint32)(size - at)) { ok = false; n = size - at; }
+      at += n;
+    }
+  };
+
+  struct Event {
+    quint32 tick;
+    int     key;     // -1 ends the note sounding
+  };
+
+  struct Tempo {
+    quint32 tick;
+    quint32 micros;  // per quarter note
+  };
+
+  /** ----------------------------------------------------------------------
+   * @brief milliseconds method convert a tick to time with the tempo map.
+   */
+  static double milliseconds(const QList<Tempo>& tempos, quint32 division,
+                             quint32 tick) {
+    double ms = 0;
+    quint32 from = 0, micros = 500000;
+    foreach (Tempo t, tempos) {
+      if (t.tick >= tick) break;
+      ms += (t.tick - from) * (micros / 1000.0) / division;
+      from = t.tick;
+      micros = t.micros;
+    }
+    return ms + (tick - from) * (micros / 1000.0) / division;
+  }
+
+public:
+
+  static bool parseMidi(const QByteArray& file, QList<Note>& notes) {
+    Bytes in((const byte*)file.constData(), file.size());
+    notes.clear();
+    if (in.u32() != 0x4D546864 || in.u32() != 6) return false;   // "MThd"
+    in.u16();                                                     // format
+    quint32 tracks = in.u16();
+    quint32 division = in.u16();
+    if (!in.ok || division == 0 || (division & 0x8000)) return false;
+
+    QList<Tempo> tempos;
+    QList<Event> melody;
+    for (quint32 track=0; track<tracks && in.more(); track++) {
+      quint32 type = in.u32();
+      quint32 length = in.u32();
+      if (!in.ok || length > (quint32)(in.size - in.at)) return false;
+      Bytes chunk(in.data + in.at, length);
+      in.skip(length);
+      if (type != 0x4D54726B) continue;                           // "MTrk"
+
+      QList<Event> events;
+      quint32 tick = 0;
+      byte status = 0;
+      int sounding = -1;
+      while (chunk.more()) {
+        tick += chunk.vlq();
+        byte b = chunk.u8();
+        if (b & 0x80) status = b;
+        else chunk.at--;                                // running status
+        if (status == 0xFF) {
+          byte meta = chunk.u8();
+          quint32 size = chunk.vlq();
+          if (meta == 0x51 && size == 3) {
+            Tempo t = { tick, 0 };
+            t.micros = chunk.u8() << 16;
+            t.micros |= chunk.u8() << 8;
+            t.micros |= chunk.u8();
+            tempos.append(t);
+          }
+          else {
+            chunk.skip(size);
+          }
+          status = 0;
+          continue;
+        }
+        if (status == 0xF0 || status == 0xF7) {
+          chunk.skip(chunk.vlq());
+          status = 0;
+          continue;
+        }
+        if (status < 0x80) return false;
+        int kind = status >> 4, channel = status & 0x0F;
+        byte key = chunk.u8();
+        byte velocity = (kind == 0xC || kind == 0xD) ? 0 : chunk.u8();
+        if (channel == 9) continue;                     // percussion
+        if (kind == 0x9 && velocity > 0) {
+          Event e = { tick, key };
+          events.append(e);
+          sounding = key;
+        }
+        else if ((kind == 0x8 || kind == 0x9) && key == sounding) {
+          Event e = { tick, -1 };
+          events.append(e);
+          sounding = -1;
+        }
+      }
+      if (!chunk.ok) return false;
+      if (melody.isEmpty()) melody = events;
+    }
+
+    // tracks of format 1 are merged by time, tempos may come from any one
+    for (int i=1; i<tempos.size(); i++) {
+      for (int j=i; j>0 && tempos[j-1].tick > tempos[j].tick; j--) {
+        tempos.swap(j-1, j);
+      }
+    }
+    for (int i=0; i<melody.size(); i++) {
+      if (melody[i].key < 0) continue;
+      quint32 end = i+1 < melody.size() ? melody[i+1].tick
+                                        : melody[i].tick + division;
+      double start = milliseconds(tempos, division, melody[i].tick);
+      double length = milliseconds(tempos, division, end) - start;
+      if (length > 0) add(notes, melody[i].key, start, length * 8 / 7);
+    }
+    return !notes.isEmpty();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief load method read a score, MIDI files are known by their header.
+   */
+  static bool load(QString path, QList<Note>& notes) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    QByteArray content = f.readAll();
+    f.close();
+    if (content.startsWith("MThd")) return parseMidi(content, notes);
+    return parseText(content, notes);
+  }
+};
+
+/** ========================================================================
+ * @brief Melody class play a score with PLAYTONE telegrams from its own
+ * thread.  Each telegram is sent at an absolute deadline, the start of its
+ * note minus the one-way latency of the link, so notes sound at their time
+ * in brick and not when Bluetooth delivers them.  Latency is half of the
+ * round trip of the PLAYTONE replies (and of some KEEPALIVE probes before
+ * the first note), smoothed as TCP does.  For each note it reports how late
+ * the telegram was written over its deadline (jitter of scheduling and of
+ * queues of Network) and the round trip of its reply.  Times are taken
+ * when the telegram is written (see WriteHandler), so the round trip is
+ * the one of the link only.
+ */
+class Melody : public QThread, public ReplyHandler, public WriteHandler {
+public:
+  enum {
+    LEAD   = 300,      // ms before the first note, probes in first half
+    PROBES = 3,
+    SLICE  = 20        // ms, longest sleep without looking at "running"
+  };
+
+  struct Report {
+    uint16_t frequency;
+    uint16_t duration;
+    qint64   jitter;     // ns sent after the deadline
+    qint64   roundtrip;  // ns, -1 when reply was lost
+  };
+
+private:
+  struct Sent {
+    int    note;         // -1 for probes
+    byte   opcode;
+    qint64 deadline;
+    qint64 at;           // written to brick, 0 while queued
+  };
+
+  Network*        net;
+  QMutex          lock;
+  QAtomicInt      running;
+  QList<Note>     notes;
+  QVector<Report> reports;
+  QQueue<Sent>    sent;
+  int             played;    // notes sent
+  int             finished;  // notes with known round trip
+  qint64          oneWay;    // ns, 0 while unknown
+  bool            attached;
+
+  /** ----------------------------------------------------------------------
+   * @brief send method request a telegram, "written" will tell when it
+   * left.
+   */
+  bool send(const Telegram& t, int note, qint64 deadline = 0) {
+    QMutexLocker locker(&lock);
+    Sent s = { note, t.bytes()[3], deadline, 0 };
+    sent.enqueue(s);
+    if (net->request(t, this, Network::SETPOINT, this)) return true;
+    sent.removeLast();
+    return false;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief sleepUntil method wait an absolute time in slices, so a stop is
+   * not delayed by long rests.
+   * @return false when playing was stopped
+   */
+  bool sleepUntil(qint64 deadline) {
+    while (running.load()) {
+      qint64 wake = qMin(deadline, monotonic() + SLICE*1000000LL);
+      struct timespec t;
+      t.tv_sec  = wake / 1000000000LL;
+      t.tv_nsec = wake % 1000000000LL;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL));
+      if (wake >= deadline) return running.load();
+    }
+    return false;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief lose method finish reports of notes without reply.  Lock must
+   * be taken.
+   */
+  void lose() {
+    while (finished < played) reports[finished++].roundtrip = -1;
+  }
+
+protected:
+
+  void run() {
+    qint64 start = monotonic();
+    qint64 begin = start + LEAD*1000000LL;
+    for (int i=0; i<PROBES; i++) {
+      if (!sleepUntil(start + i*LEAD*1000000LL/(2*PROBES))) return;
+      send(Telegram(KeepAlive()), -1);
+    }
+    for (int i=0; i<notes.size(); i++) {
+      const Note& n = notes[i];
+      lock.lock();
+      qint64 deadline = begin + n.start*1000000LL - oneWay;
+      lock.unlock();
+      if (!sleepUntil(deadline)) return;
+      qint64 now = monotonic();
+      lock.lock();
+      reports[i].frequency = n.frequency;
+      reports[i].duration  = n.duration;
+      reports[i].jitter    = now - deadline;
+      reports[i].roundtrip = -1;
+      played = i + 1;
+      lock.unlock();
+      if (!send(Telegram(PlayTone(n.frequency, n.duration), true), i,
+                deadline)) {
+        QMutexLocker locker(&lock);
+        lose();
+      }
+    }
+  }
+
+public:
+
+  Melody(Network* n) : net(n), running(0), played(0), finished(0),
+                       oneWay(0), attached(false) {
+  }
+
+  ~Melody() {
+    stop();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief play method start "score", stopping the melody playing.
+   */
+  bool play(const QList<Note>& score) {
+    stop();
+    if (!attached || score.isEmpty()) return false;
+    net->forget(this);
+    net->forgetWrites(this);
+    {
+      QMutexLocker locker(&lock);
+      notes = score;
+      reports.fill(Report(), notes.size());
+      sent.clear();
+      played = finished = 0;
+      oneWay = 0;
+    }
+    running.store(1);
+    start();
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief stop method end the melody and silence the brick.  The stop goes
+   * by safety lane, so it is still written when brick is unbound next.
+   */
+  void stop() {
+    running.store(0);
+    wait();
+    if (!attached) return;
+    net->directCommand(Telegram(StopSoundPlayback()), Network::SAFETY);
+    net->forget(this);
+    net->forgetWrites(this);
+    QMutexLocker locker(&lock);
+    lose();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setAttached method tell melody if brick is connected, it must
+   * be called before Network::unbind.
+   */
+  void setAttached(bool on) {
+    if (!on) stop();
+    attached = on;
+  }
+
+  bool active() { return isRunning(); }
+
+  /** ----------------------------------------------------------------------
+   * @brief reported method copy reports of notes with known round trip
+   * from "from" on.
+   * @return count of notes with known round trip
+   */
+  int reported(int from, QList<Report>& out) {
+    QMutexLocker locker(&lock);
+    out.clear();
+    for (int i=from; i<finished; i++) out.append(reports[i]);
+    return finished;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief latency method return the one-way latency estimated, in ns.
+   */
+  qint64 latency() {
+    QMutexLocker locker(&lock);
+    return oneWay;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief replied method measure the round trip of each reply.  Network
+   * gives replies in the order of requests, a lost one (NULL) only ends
+   * the report of its note.
+   */
+  void replied(const byte* bytes, int count) {
+    qint64 now = monotonic();
+    Reply reply(bytes, count);
+    QMutexLocker locker(&lock);
+    if (sent.isEmpty()) return;
+    Sent s = sent.dequeue();
+    bool measured = bytes && s.at > 0 && s.opcode == reply.command();
+    if (measured) {
+      qint64 half = (now - s.at) / 2;
+      oneWay = oneWay == 0 ? half : oneWay + (half - oneWay) / 8;
+    }
+    if (s.note < 0) return;
+    while (finished < s.note) reports[finished++].roundtrip = -1;
+    reports[finished++].roundtrip = measured ? now - s.at : -1;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief written method, from sender thread of Network, keep when the
+   * oldest request still queued left, and the jitter of its note.
+   */
+  void written(qint64 at) {
+    QMutexLocker locker(&lock);
+    for (int i=0; i<sent.size(); i++) {
+      if (sent[i].at > 0) continue;
+      sent[i].at = at;
+      if (sent[i].note >= 0) {
+        reports[sent[i].note].jitter = at - sent[i].deadline;
+      }
+      return;
+    }
+  }
+};
+
+/** ========================================================================
+ * @brief MelodyPanel class is the window to open a score, play it and see
+ * the timing of each note.
+ */
+class MelodyPanel : public QFrame {
+  Q_OBJECT
+private:
+  Melody*      melody;
+  Idiom*       idiom;
+  QList<Note>  score;
+  QPushButton  *open,*play,*stop;
+  QLabel       *file,*summary;
+  QListWidget* list;
+  QTimer*      timer;
+  int          shown;
+  qint64       jitterSum, jitterMax;
+
+public:
+
+  MelodyPanel(Melody* m, Idiom* i)
+    : melody(m), idiom(i), shown(0), jitterSum(0), jitterMax(0) {
+    open    = new QPushButton();
+    play    = new QPushButton();
+    stop    = new QPushButton();
+    file    = new QLabel();
+    summary = new QLabel();
+    list    = new QListWidget();
+    timer   = new QTimer(this);
+    play->setEnabled(false);
+
+    QHBoxLayout* buttons = new QHBoxLayout();
+    buttons->addWidget(open);
+    buttons->addWidget(play);
+    buttons->addWidget(stop);
+    QVBoxLayout* layout = new QVBoxLayout();
+    setLayout(layout);
+    layout->addLayout(buttons);
+    layout->addWidget(file);
+    layout->addWidget(list);
+    layout->addWidget(summary);
+    setMinimumSize(420, 360);
+    refreshIdiom();
+
+    connect(open,SIGNAL(clicked()),this,SLOT(openScore()));
+    connect(play,SIGNAL(clicked()),this,SLOT(playScore()));
+    connect(stop,SIGNAL(clicked()),this,SLOT(stopScore()));
+    connect(timer,SIGNAL(timeout()),this,SLOT(refreshReports()));
+  }
+
+  void refreshIdiom() {
+    setWindowTitle(idiom->text(TXT_MENUMELODY));
+    open->setText(idiom->text(TXT_MELODYOPEN));
+    play->setText(idiom->text(TXT_MELODYPLAY));
+    stop->setText(idiom->text(TXT_MELODYSTOP));
+  }
+
+public slots:
+
+  void openScore() {
+    QString path = QFileDialog::getOpenFileName(this);
+    if (path.isEmpty()) return;
+    if (!Score::load(path, score)) {
+      score.clear();
+      file->setText(idiom->text(TXT_MELODYUNREADABLE));
+    }
+    else {
+      const Note& last = score.last();
+      file->setText(QFileInfo(path).fileName() + "  " +
+                    idiom->text(TXT_MELODYSCORE).arg(score.size())
+                    .arg((last.start + last.duration) / 1000.0, 0, 'f', 1));
+    }
+    play->setEnabled(!score.isEmpty());
+  }
+
+  void playScore() {
+    list->clear();
+    summary->setText("");
+    shown = 0;
+    jitterSum = jitterMax = 0;
+    if (melody->play(score)) timer->start(100);
+  }
+
+  void stopScore() {
+    melody->stop();
+    refreshReports();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief refreshReports method add the notes with known round trip and
+   * show mean and maximum jitter, and latency of link.
+   */
+  void refreshReports() {
+    QList<Melody::Report> reports;
+    int finished = melody->reported(shown, reports);
+    foreach (Melody::Report r, reports) {
+      shown++;
+      jitterSum += r.jitter;
+      jitterMax = qMax(jitterMax, r.jitter);
+      QString roundtrip = r.roundtrip < 0 ? QString("-") :
+                          QString::number(r.roundtrip / 1000000.0, 'f', 1);
+      list->addItem(idiom->text(TXT_MELODYNOTE).arg(shown)
+                    .arg(r.frequency).arg(r.duration)
+                    .arg(r.jitter / 1000).arg(roundtrip));
+    }
+    if (!reports.isEmpty()) list->scrollToBottom();
+    if (finished > 0) {
+      summary->setText(idiom->text(TXT_MELODYSUMMARY)
+                       .arg(jitterSum / finished / 1000)
+                       .arg(jitterMax / 1000)
+                       .arg(melody->latency() / 1000000.0, 0, 'f', 1));
+    }
+    if (!melody->active() && finished == shown) timer->stop();
+  }
+};
+
+#endif // MELODY_H
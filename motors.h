@@ -0,0 +1,87 @@
+#ifndef MOTORS_H
+#define MOTORS_H
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <network.h>
+#include <controller.h>
+
+/** ========================================================================
+ * @brief Motors class keep the power last sent to ports A, B and C, and
+ * send only the ones that change, all of them in one write (or as targets
+ * of controller when it is active).  Stops go by the safety lane of
+ * Network, ahead of any other traffic.  Keyboard and gamepad use it from
+ * different threads.
+ */
+class Motors {
+private:
+  Network*    net;
+  Controller* controller;
+  QMutex      lock;
+  signed char setpoints[3];
+
+public:
+
+  Motors(Network* n, Controller* c) : net(n), controller(c) {
+    setpoints[PORT_A] = setpoints[PORT_B] = setpoints[PORT_C] = 0;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief apply method put the power of the three ports, stopped motors
+   * are braked.  A setpoint is kept only when its telegram was queued, so
+   * a refused one is sent again by next call.  "observer" is told when
+   * each telegram is written.
+   * @return count of telegrams sent
+   */
+  int apply(const signed char wanted[3], WriteHandler* observer = NULL) {
+    QMutexLocker locker(&lock);
+    Telegram stops[3], changes[3];
+    byte stopped[3], changed[3];
+    int halted = 0, count = 0;
+    for (byte port=PORT_A; port<=PORT_C; port++) {
+      if (wanted[port] == setpoints[port]) continue;
+      if (controller->active()) {
+        controller->setTarget(port,
+                              wanted[port] * Controller::MAXSPEED / 100.0);
+        setpoints[port] = wanted[port];
+      }
+      else if (wanted[port] == 0) {
+        stopped[halted] = port;
+        stops[halted++] = Telegram(SetOutputState(port, 0,
+                                   MODE_MOTORON|MODE_BRAKE));
+      }
+      else {
+        changed[count] = port;
+        changes[count++] = Telegram(SetOutputState(port, wanted[port]));
+      }
+    }
+    int sent = 0;
+    if (halted > 0 &&
+        net->directCommands(stops, halted, Network::SAFETY, observer)) {
+      for (int i=0; i<halted; i++) setpoints[stopped[i]] = 0;
+      sent += halted;
+    }
+    if (count > 0 &&
+        net->directCommands(changes, count, Network::SETPOINT, observer)) {
+      for (int i=0; i<count; i++) setpoints[changed[i]] = wanted[changed[i]];
+      sent += count;
+    }
+    return sent;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setpoint method return the power last accepted for "port".
+   */
+  signed char setpoint(byte port) {
+    QMutexLocker locker(&lock);
+    return setpoints[port];
+  }
+
+  void stop() {
+    signed char zero[3] = { 0, 0, 0 };
+    apply(zero);
+  }
+};
+
+#endif // MOTORS_H
@@ -1,56 +1,74 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
-typedef unsigned char byte;
-
 #include <QStringList>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QWaitCondition>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
 #include <unistd.h>
 #include <bluetooth/rfcomm.h>
 #include <iostream>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include <protocol.h>
+#include <capture.h>
+
+/** ------------------------------------------------------------------------
+ * @brief monotonic function return nanoseconds of the monotonic clock, the
+ * same clock used by clock_nanosleep to wait absolute deadlines.
+ */
+inline qint64 monotonic() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (qint64)now.tv_sec*1000000000LL + now.tv_nsec;
+}
 
 /** ========================================================================
  * @brief The Telegram class transport all information between Window class
- * and Network class.
+ * and Network class.  Its bytes live inside the object, so building one
+ * never touch the heap.
  */
 class Telegram {
 private:
-  byte* content;
-  int   size;
+  byte content[MAXTELEGRAM];
+  int  size;
 public:
 
   /** ----------------------------------------------------------------------
    * @brief Telegram constructor launch its attributes and set de three first
    * bytes of telegram.  These bytes are mecanically
    */
-  Telegram() : content(NULL) , size(3) {
-    content = new byte[size];
+  Telegram() : size(3) {
     content[0] = size-2;
     content[1] = 0x00;
-    content[2] = 0x80; // Direct Command whitout response
+    content[2] = DIRECTNOREPLY;
   }
 
   /** ----------------------------------------------------------------------
-   * @brief Telegram constructor to copy process events.
+   * @brief Telegram constructor with a request of protocol.h, encoded
+   * directly in telegram content.
    */
-  Telegram(Telegram& source) {
-    size = source.size;
-    content = new byte[size];
-    for (int i=0;i<size;i++) content[i] = source.content[i];
+  template <class Request>
+  Telegram(const Request& request, bool reply = Request::replies) {
+    size = encode(request, content, MAXTELEGRAM, reply);
   }
 
   /** ----------------------------------------------------------------------
    * @brief append method, add new bytes to end of telegram.
    */
   void append(byte piece) {
-    byte* aux = new byte[size+1];
-    for (int i=0;i<size;i++) aux[i] = content[i];
-    aux[size] = piece;
-    delete content;
-    content = aux;
-    size++;
+    if (size >= MAXTELEGRAM) return;
+    content[size++] = piece;
     content[0] = size-2;
   }
 
@@ -58,39 +76,278 @@ public:
    * @brief append method with more than one bytes... add to end of telegram
    * all bytes sended in "pieces" array.
    */
-  void append(byte* pieces, int count) {
+  void append(const byte* pieces, int count) {
     for (int i=0; i<count; i++) {
       append(pieces[i]);
     }
   }
 
+  const byte* bytes()  const { return content; }
+  int         length() const { return size; }
+
   /** ----------------------------------------------------------------------
-   * @brief Telegram destructor is important to keep clear to computer
-   * memory
+   * @brief asksReply method tell if brick will answer the telegram.
    */
-  ~Telegram() {
-    delete content;
+  bool asksReply() const {
+    return size > 3 && !(content[2] & 0x80);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setReply method ask reply to brick or not, keeping the kind
+   * (direct or system) of telegram.
+   */
+  void setReply(bool reply) {
+    if (size > 2) content[2] = (content[2] & 0x7F) | (reply ? 0x00 : 0x80);
   }
 
   /** ----------------------------------------------------------------------
    * @brief send method put in socket communications the telegram.
    */
-  bool send(int sock) {
-    return write(sock, content, size);
+  bool send(int sock) const {
+    return size > 0 && write(sock, content, size) == size;
+  }
+};
+
+/** ========================================================================
+ * @brief ReplyHandler class is the interface of objects that wait replies
+ * of telegrams.  "replied" method is called from receiver thread once for
+ * each request, in the order they were sent, with the reply bytes (without
+ * length bytes), valid only during the call.  When the reply was lost,
+ * "reply" is NULL and "count" zero.
+ */
+class ReplyHandler {
+public:
+  virtual ~ReplyHandler() {}
+  virtual void replied(const byte* reply, int count) = 0;
+};
+
+/** ========================================================================
+ * @brief WriteHandler class is the interface of objects that want to know
+ * when their telegrams leave to brick, and not when they were queued.
+ * "written" is called from sender thread once for each telegram, in the
+ * order they are written, with the monotonic time taken just before the
+ * write (so before its reply can arrive).  It must not call Network.
+ */
+class WriteHandler {
+public:
+  virtual ~WriteHandler() {}
+  virtual void written(qint64 at) = 0;
+};
+
+class Network;
+
+/** ========================================================================
+ * @brief Receiver class is the thread that read replies of brick while a
+ * connection is open.
+ */
+class Receiver : public QThread {
+private:
+  Network* net;
+public:
+  Receiver(Network* n) : net(n) {
   }
+  void run();
 };
 
+/** ========================================================================
+ * @brief Sender class is the thread that write telegrams queued to brick
+ * while a connection is open.
+ */
+class Sender : public QThread {
+private:
+  Network* net;
+public:
+  Sender(Network* n) : net(n) {
+  }
+  void run();
+};
 
 /** ========================================================================
  * @brief The Network class work as low level, allow send and recive
  * information of Bluetooth device connected.
+ *
+ * Telegrams are not written by callers: they are queued in one of three
+ * lanes and Sender thread writes them, always from the first lane not
+ * empty, so a stop waits at most the telegram being written, never the
+ * traffic queued before it.  Telegrams of a lane keep their order; older
+ * powers of a port still queued when its stop arrives become that stop,
+ * so a port never runs again after it.  Bulk
+ * lane (queries, files) has a budget of bytes per second, kept below the
+ * speed of the link, so the socket buffer of kernel, where priorities do
+ * not exist, stays almost empty.
  */
 class Network {
+public:
+  enum { RACEWIDTH  = 7,      // active links of a Bluetooth adapter
+         BATCH      = 8,      // telegrams written at once
+         LANEDEPTH  = 64,     // telegrams queued in a lane
+         BULKBUDGET = 4096,   // bytes per second of bulk lane
+         BULKBURST  = 2*MAXTELEGRAM,
+         DRAINTIME  = 500 };  // ms to write safety lane on unbind
+
+  enum lane {
+    SAFETY,     // stops
+    SETPOINT,   // motors, control loops, sounds
+    BULK,       // queries, files, background work
+    LANES
+  };
+
 private:
-  QString macAddress;
-  int     sock;
+  struct Pending {
+    ReplyHandler* handler;
+    byte          opcode;
+  };
+
+  struct Outgoing {
+    Telegram      telegram;
+    ReplyHandler* handler;
+    WriteHandler* observer;
+    bool          expects;   // a reply, even when handler was forgotten
+  };
+
+  QString          macAddress;
+  int              sock;
+  Receiver*        receiver;
+  Sender*          sender;
+  QMutex           matching;     // "pending"
+  QMutex           dispatching;
+  QMutex           announcing;   // calls of WriteHandler
+  QMutex           queueing;     // lanes, taken before "matching"
+  QWaitCondition   queued;
+  QQueue<Outgoing> lanes[LANES];
+  bool             stopping;
+  int              budget;       // bytes per second of bulk, 0 unlimited
+  double           tokens;       // bytes bulk may write now
+  qint64           refilled;
+  QQueue<Pending>  pending;
+  Capture*         capture;
+
+  /** ----------------------------------------------------------------------
+   * @brief readFully method wait until "count" bytes arrive from brick.
+   */
+  bool readFully(byte* buffer, int count) {
+    while (count > 0) {
+      int n = read(sock, buffer, count);
+      if (n <= 0) return false;
+      buffer += n;
+      count -= n;
+    }
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief startThreads method start Receiver and Sender threads of a new
+   * connection.
+   */
+  void startThreads() {
+    queueing.lock();
+    stopping = false;
+    tokens = BULKBURST;
+    refilled = monotonic();
+    queueing.unlock();
+    receiver = new Receiver(this);
+    receiver->start();
+    sender = new Sender(this);
+    sender->start();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief ready method tell if "count" telegrams fit in "lane".  Lock
+   * "queueing" must be taken.
+   */
+  bool ready(int lane, int count) {
+    return sock >= 0 && !stopping && lane >= 0 && lane < LANES &&
+           lanes[lane].size() + count <= LANEDEPTH;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief next method choose the lane to write, refilling the budget of
+   * bulk lane.  Lock "queueing" must be taken.
+   * @return the lane, or -1 when nothing can be written now
+   */
+  int next() {
+    qint64 now = monotonic();
+    tokens = qMin((double)BULKBURST, tokens + (now - refilled)*budget/1e9);
+    refilled = now;
+    if (!lanes[SAFETY].isEmpty()) return SAFETY;
+    if (!lanes[SETPOINT].isEmpty()) return SETPOINT;
+    if (!lanes[BULK].isEmpty() &&
+        (budget <= 0 || lanes[BULK].head().telegram.length() <= tokens)) {
+      return BULK;
+    }
+    return -1;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief supersede method, when "stop" (a SETOUTPUTSTATE) is queued in
+   * safety lane, turn the SETOUTPUTSTATE of same port still waiting in
+   * other lanes into copies of it.  They would be written after the stop
+   * and start the motor again with an older power.  Copies keep if their
+   * original asked reply, so handlers and pending replies do not change.
+   * Lock "queueing" must be taken.
+   */
+  void supersede(const Telegram& stop) {
+    if (stop.length() < 5 || stop.bytes()[3] != OP_SETOUTPUTSTATE) return;
+    byte port = stop.bytes()[4];
+    for (int l=SAFETY+1; l<LANES; l++) {
+      for (int i=0; i<lanes[l].size(); i++) {
+        Telegram& t = lanes[l][i].telegram;
+        if (t.length() < 5 || t.bytes()[3] != OP_SETOUTPUTSTATE) continue;
+        if (port != PORT_ALL && t.bytes()[4] != port) continue;
+        bool reply = t.asksReply();
+        t = stop;
+        t.setReply(reply);
+      }
+    }
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief expect method queue handlers of replies of a batch, before it is
+   * written so no reply arrives first.  Lock "matching" must be taken.
+   */
+  void expect(const Outgoing* batch, int count) {
+    for (int i=0; i<count; i++) {
+      if (!batch[i].expects) continue;
+      Pending p = { batch[i].handler, batch[i].telegram.bytes()[3] };
+      pending.enqueue(p);
+    }
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief deliver method put telegrams in socket with a single write.  No
+   * lock is taken, only Sender thread writes.  When it fails the link is
+   * broken and its pending replies are forgotten by "unbind".
+   */
+  bool deliver(const Outgoing* batch, int count) {
+    struct iovec pieces[BATCH];
+    int total = 0;
+    for (int i=0; i<count; i++) {
+      const Telegram& t = batch[i].telegram;
+      pieces[i].iov_base = (void*) t.bytes();
+      pieces[i].iov_len  = t.length();
+      total += t.length();
+    }
+    if (writev(sock, pieces, count) != total) return false;
+    for (int i=0; capture && i<count; i++) {
+      capture->record(Capture::OUTGOING, batch[i].telegram.bytes(),
+                      batch[i].telegram.length());
+    }
+    return true;
+  }
+
 public:
 
+  /** ----------------------------------------------------------------------
+   * @brief Network constructor, there is not connection yet.
+   */
+  Network() : sock(-1), receiver(NULL), sender(NULL), stopping(false),
+              budget(BULKBUDGET), tokens(0), refilled(0), capture(NULL) {
+  }
+
+  ~Network() {
+    unbind();
+  }
+
   /** ----------------------------------------------------------------------
    * @brief scanDevices method... search bluetooth devices around of computer.
    * This method will inactive the application during 10 seconds approximately.
@@ -140,51 +397,378 @@ public:
     return devices;
   }
 
+  /** ----------------------------------------------------------------------
+   * @brief rfcomm method open a RFCOMM connection with a device, nothing
+   * else (used also by relay mode).
+   * @return connected socket, or -1 when device is not available.
+   */
+  static int rfcomm(QString address) {
+    struct sockaddr_rc addr;
+    memset(&addr, 0, sizeof(addr));
+    int s = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+    if (s < 0) return -1;
+    addr.rc_family = AF_BLUETOOTH;
+    addr.rc_channel = (uint8_t) 1;
+    str2ba( address.toStdString().c_str(), &addr.rc_bdaddr );
+    if ( connect(s, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      return s;
+    }
+    close(s);
+    return -1;
+  }
+
   /** ----------------------------------------------------------------------
    * @brief bind methoc... connect the applications with wanted device.
    */
   bool bind(QString address) {
     macAddress = address;
-    struct sockaddr_rc addr; //  = { 0 };
-    sock = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-    addr.rc_family = AF_BLUETOOTH;
-    addr.rc_channel = (uint8_t) 1;
-    str2ba( macAddress.toStdString().c_str(), &addr.rc_bdaddr );
-    if ( connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
-      return true;
+    sock = rfcomm(address);
+    if (sock < 0) return false;
+    startThreads();
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief bindSocket method use a socket already connected with a brick,
+   * or with a stand-in of it (tools/lanes.cpp).  Network closes it.
+   */
+  bool bindSocket(int s, QString address) {
+    if (sock >= 0 || s < 0) return false;
+    macAddress = address;
+    sock = s;
+    startThreads();
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief race method connect with the first device that answers among
+   * "addresses".  All connections start at once, without blocking, and the
+   * first one ready is kept while the rest are closed.  Earlier addresses
+   * win ties.  Kernel may still page devices one by one, so best
+   * candidates should come first.
+   * @param deadline in ms for all connections
+   * @param latencies receive ms of each connection, -1 when it failed, -2
+   * when it was cancelled because other device won, -3 when it was still
+   * in progress at deadline (maybe never paged)
+   * @return index of connected address, or -1 when nobody answered
+   */
+  int race(QStringList addresses, int deadline, QList<int>& latencies) {
+    int count = qMin(addresses.size(), (int)RACEWIDTH);
+    struct pollfd fds[RACEWIDTH];
+    qint64 start = monotonic();
+    int winner = -1;
+    latencies.clear();
+
+    for (int i=0; i<count; i++) {
+      latencies.append(-1);
+      struct sockaddr_rc addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.rc_family = AF_BLUETOOTH;
+      addr.rc_channel = (uint8_t) 1;
+      str2ba( addresses[i].toStdString().c_str(), &addr.rc_bdaddr );
+      int s = socket(AF_BLUETOOTH, SOCK_STREAM|SOCK_NONBLOCK, BTPROTO_RFCOMM);
+      if (s >= 0 && connect(s, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        if (winner < 0) {
+          winner = i;
+          latencies[i] = (monotonic() - start) / 1000000;
+        }
+      }
+      else if (s >= 0 && errno != EINPROGRESS) {
+        close(s);
+        s = -1;
+      }
+      fds[i].fd = s;
+      fds[i].events = POLLOUT;
+      fds[i].revents = 0;
     }
-    else {
-      return false;
+
+    while (winner < 0) {
+      int left = deadline - (monotonic() - start) / 1000000;
+      bool waiting = false;
+      for (int i=0; i<count; i++) waiting = waiting || fds[i].fd >= 0;
+      if (left <= 0 || !waiting) break;
+      int n = poll(fds, count, left);
+      if (n < 0 && errno != EINTR) break;
+      for (int i=0; i<count && n>0; i++) {
+        if (fds[i].fd < 0 || fds[i].revents == 0) continue;
+        int error = 0;
+        socklen_t size = sizeof(error);
+        getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &size);
+        if (error == 0 && winner < 0) {
+          winner = i;
+          latencies[i] = (monotonic() - start) / 1000000;
+        }
+        else if (error != 0) {
+          close(fds[i].fd);
+          fds[i].fd = -1;
+        }
+      }
     }
+
+    for (int i=0; i<count; i++) {
+      if (i == winner || fds[i].fd < 0) continue;
+      close(fds[i].fd);
+      latencies[i] = winner >= 0 ? -2 : -3;
+    }
+    if (winner < 0) return -1;
+
+    sock = fds[winner].fd;
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+    macAddress = addresses[winner];
+    startThreads();
+    return winner;
   }
 
   /** ----------------------------------------------------------------------
-   * @brief unbind method... disconnect the applications
+   * @brief unbind method... disconnect the applications.  Telegrams of
+   * setpoint and bulk lanes are dropped, but stops of safety lane queued
+   * just before are still written: Sender ends when that lane is empty (or
+   * after DRAINTIME when link does not take them).  Receiver is woken up by
+   * shutdown and all pending replies are forgotten.
    */
   void unbind() {
+    if (sock < 0) return;
+    queueing.lock();
+    stopping = true;
+    lanes[SETPOINT].clear();
+    lanes[BULK].clear();
+    queued.wakeAll();
+    queueing.unlock();
+    if (sender) sender->wait(DRAINTIME);
+    shutdown(sock, SHUT_RDWR);
+    if (sender) {
+      sender->wait();
+      delete sender;
+      sender = NULL;
+    }
+    if (receiver) {
+      receiver->wait();
+      delete receiver;
+      receiver = NULL;
+    }
     close(sock);
+    sock = -1;
+    QMutexLocker locker(&matching);
+    pending.clear();
+  }
+
+  bool connected() {
+    return sock >= 0;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief getAddress method return the address of brick connected last.
+   */
+  QString getAddress() const {
+    return macAddress;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setCapture method keep a copy of all telegrams sent and received
+   * in "c" (NULL to stop), it must be set before binding.
+   */
+  void setCapture(Capture* c) {
+    capture = c;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setBulkBudget method change bytes per second of bulk lane, zero
+   * for no limit.
+   */
+  void setBulkBudget(int bytesPerSecond) {
+    QMutexLocker locker(&queueing);
+    budget = bytesPerSecond;
+    queued.wakeAll();
   }
 
   /** ----------------------------------------------------------------------
    * @brief directCommand... it's disposed to be a middle layer between
-   * GUI interface and low layer "blueZ"
+   * GUI interface and low layer "blueZ".  Telegram is queued in "lane".
+   * @return false when not connected or lane is full
    */
-  bool directCommand(Telegram t) {
-    t.send(sock);
+  bool directCommand(const Telegram& t, int lane = SETPOINT) {
+    return directCommands(&t, 1, lane);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief directCommands method queue some telegrams (up to BATCH) at
+   * once, so they leave together to brick in a single write.  "observer"
+   * is told when each one is written.
+   */
+  bool directCommands(const Telegram* telegrams, int count,
+                      int lane = SETPOINT, WriteHandler* observer = NULL) {
+    QMutexLocker locker(&queueing);
+    if (count > BATCH || !ready(lane, count)) return false;
+    for (int i=0; i<count; i++) {
+      Outgoing o = { telegrams[i], NULL, observer,
+                     telegrams[i].asksReply() };
+      lanes[lane].enqueue(o);
+      if (lane == SAFETY) supersede(telegrams[i]);
+    }
+    queued.wakeOne();
     return true;
   }
 
+  /** ----------------------------------------------------------------------
+   * @brief request method send a telegram that ask reply, without waiting
+   * for it.  Brick answers in order, so "handler" is queued when telegram
+   * is written and it will be called by receiver thread when its reply
+   * arrive.  Many requests can be in flight at same time.  "observer" is
+   * told when the telegram is written.
+   */
+  bool request(const Telegram& t, ReplyHandler* handler,
+               int lane = SETPOINT, WriteHandler* observer = NULL) {
+    QMutexLocker locker(&queueing);
+    if (!ready(lane, 1)) return false;
+    Outgoing o = { t, handler, observer, true };
+    lanes[lane].enqueue(o);
+    if (lane == SAFETY) supersede(t);
+    queued.wakeOne();
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief forget method discard replies still pending for "handler",
+   * also of requests not written yet.  On return, receiver thread is not
+   * inside "handler" and it will not be called anymore.  It must not be
+   * called from a "replied" method.
+   */
+  void forget(ReplyHandler* handler) {
+    queueing.lock();
+    matching.lock();
+    for (int l=0; l<LANES; l++) {
+      for (int i=0; i<lanes[l].size(); i++) {
+        if (lanes[l][i].handler == handler) lanes[l][i].handler = NULL;
+      }
+    }
+    for (int i=0; i<pending.size(); i++) {
+      if (pending[i].handler == handler) pending[i].handler = NULL;
+    }
+    matching.unlock();
+    queueing.unlock();
+    dispatching.lock();
+    dispatching.unlock();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief forgetWrites method is "forget" for a WriteHandler: on return,
+   * sender thread is not inside "observer" and it will not be called
+   * anymore.
+   */
+  void forgetWrites(WriteHandler* observer) {
+    queueing.lock();
+    for (int l=0; l<LANES; l++) {
+      for (int i=0; i<lanes[l].size(); i++) {
+        if (lanes[l][i].observer == observer) lanes[l][i].observer = NULL;
+      }
+    }
+    queueing.unlock();
+    announcing.lock();
+    announcing.unlock();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief transmit method is the body of sender thread.  Each turn takes
+   * the first lane with telegrams: up to BATCH of them from safety and
+   * setpoint lanes, only one from bulk lane and when its budget allows.
+   * Replies are expected before leaving "queueing", so "forget" finds every
+   * request either queued or pending; the write is done without locks.
+   * Observers are told just before the write, under "announcing" taken
+   * before leaving "queueing", so "forget" of an observer waits them.
+   * When stopping, it ends after writing the safety lane.
+   */
+  void transmit() {
+    Outgoing batch[BATCH];
+    queueing.lock();
+    while (!stopping || !lanes[SAFETY].isEmpty()) {
+      int lane = next();
+      if (lane < 0) {
+        if (lanes[BULK].isEmpty()) {
+          queued.wait(&queueing);
+        }
+        else {
+          double missing = lanes[BULK].head().telegram.length() - tokens;
+          queued.wait(&queueing, (unsigned long) (missing*1000/budget) + 1);
+        }
+        continue;
+      }
+      int count = 0;
+      do {
+        batch[count++] = lanes[lane].dequeue();
+      } while (lane != BULK && count < BATCH && !lanes[lane].isEmpty());
+      if (lane == BULK) tokens -= batch[0].telegram.length();
+      matching.lock();
+      expect(batch, count);
+      matching.unlock();
+      announcing.lock();
+      queueing.unlock();
+      qint64 now = monotonic();
+      for (int i=0; i<count; i++) {
+        if (batch[i].observer) batch[i].observer->written(now);
+      }
+      announcing.unlock();
+      deliver(batch, count);
+      queueing.lock();
+    }
+    queueing.unlock();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief receive method is the body of receiver thread.  Each reply is
+   * given to the first pending handler of same command.  Brick answers in
+   * order, so pending requests before it did not get reply (lost): their
+   * handlers are told with a NULL reply.  A reply nobody waits is dropped
+   * alone, the pending ones still wait theirs.
+   */
+  void receive() {
+    byte buffer[MAXTELEGRAM];
+    while (readFully(buffer, 2)) {
+      int count = buffer[0] | (buffer[1] << 8);
+      if (count < 3 || count > MAXCOMMAND) break;
+      if (!readFully(buffer+2, count)) break;
+      if (capture) capture->record(Capture::INCOMING, buffer, count+2);
+
+      matching.lock();
+      int lost = 0;
+      while (lost < pending.size() && pending[lost].opcode != buffer[3]) {
+        lost++;
+      }
+      if (lost == pending.size()) {
+        matching.unlock();
+        continue;
+      }
+      for (;; lost--) {
+        ReplyHandler* handler = pending.dequeue().handler;
+        dispatching.lock();
+        matching.unlock();
+        if (handler && lost > 0) handler->replied(NULL, 0);
+        else if (handler)        handler->replied(buffer+2, count);
+        dispatching.unlock();
+        if (lost == 0) break;
+        matching.lock();
+      }
+    }
+  }
+
   /** ----------------------------------------------------------------------
    * @brief directCommand with bytes array... it's disposed to be a middle
    * layer between GUI interface and low layer "blueZ" sended a lot of bytes
-   */  bool directCommand(byte* pieces, int count) {
+   */
+  bool directCommand(const byte* pieces, int count) {
     Telegram t;
     t.append(pieces, count);
-    t.send(sock);
-    return true;
+    return directCommand(t);
   }
 
 
 };
 
+inline void Receiver::run() {
+  net->receive();
+}
+
+inline void Sender::run() {
+  net->transmit();
+}
+
 #endif // NETWORK_H
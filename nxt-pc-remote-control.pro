@@ -8,10 +8,27 @@ SOURCES += \
 HEADERS += \
     window.h \
     network.h \
+    protocol.h \
+    capture.h \
+    controller.h \
+    telemetry.h \
+    history.h \
+    segment.h \
+    recorder.h \
+    plot.h \
+    candidates.h \
+    steering.h \
+    motors.h \
+    gamepad.h \
+    files.h \
+    melody.h \
+    shared.h \
+    relay.h \
+    idiomkeys.h \
     idiom.h
 
 RESOURCES += \
     resources.qrc
 
-LIBS += -lbluetooth
+LIBS += -lbluetooth -lrt
 
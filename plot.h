@@ -0,0 +1,133 @@
+#ifndef PLOT_H
+#define PLOT_H
+
+#include <QFrame>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QShowEvent>
+#include <QHideEvent>
+#include <QTimer>
+#include <QVector>
+#include <QPointF>
+
+#include <recorder.h>
+#include <idiom.h>
+
+/** ========================================================================
+ * @brief PlotPanel class is the window with plots of sensors, motors and
+ * battery since the panel was opened, one strip per channel.  The history
+ * is reduced to one column per pixel (minimum and maximum, see History),
+ * so painting costs the same after hours.  Repaints are asked at most
+ * FRAMERATE times per second and only when new samples arrived.
+ */
+class PlotPanel : public QFrame {
+  Q_OBJECT
+public:
+  enum { FRAMERATE = 60, LABELWIDTH = 170 };
+
+private:
+  Recorder*        recorder;
+  Idiom*           idiom;
+  History          history;
+  QTimer*          timer;
+  int              painted;   // version of history painted
+  QVector<int32_t> lows, highs;
+  QVector<QPointF> points;
+
+protected:
+
+  void showEvent(QShowEvent*) {
+    history.clear();
+    recorder->setHistory(&history);
+    timer->start(1000 / FRAMERATE);
+  }
+
+  void hideEvent(QHideEvent*) {
+    timer->stop();
+    recorder->setHistory(NULL);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief paintEvent method draw each channel in its strip, scaled to its
+   * own range, with name, last value and range at left.
+   */
+  void paintEvent(QPaintEvent*) {
+    painted = history.changes();
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(Qt::white));
+    int channels = history.count();
+    int width = qMax(1, this->width() - LABELWIDTH - 4);
+    double strip = (double) height() / channels;
+    lows.resize(width);
+    highs.resize(width);
+    points.resize(2*width);
+
+    for (int c=0; c<channels; c++) {
+      int top = (int)(c*strip);
+      int bottom = (int)((c+1)*strip) - 2;
+      int columns = history.decimate(c, width, lows.data(), highs.data());
+      int32_t low = 0, high = 0;
+      for (int x=0; x<columns; x++) {
+        if (x == 0 || lows[x] < low) low = lows[x];
+        if (x == 0 || highs[x] > high) high = highs[x];
+      }
+      painter.setPen(QColor(Qt::lightGray));
+      painter.drawLine(0, bottom+1, this->width(), bottom+1);
+      painter.setPen(QColor(Qt::black));
+      painter.drawText(4, top + 10, Recorder::names()[c]);
+      painter.drawText(4, bottom, QString::number(history.value(c)));
+      if (columns == 0) continue;
+
+      double scale = high > low ? (bottom - top - 2) / (double)(high - low)
+                                : 0;
+      double middle = (top + bottom) / 2.0;
+      for (int x=0; x<columns; x++) {
+        double px = LABELWIDTH + (double)x*width / columns;
+        if (scale > 0) {
+          points[2*x]   = QPointF(px, bottom - 1 - (highs[x]-low)*scale);
+          points[2*x+1] = QPointF(px, bottom - 1 - (lows[x]-low)*scale);
+        }
+        else {
+          points[2*x] = points[2*x+1] = QPointF(px, middle);
+        }
+      }
+      painter.setPen(QColor::fromHsv(c*360/channels, 255, 180));
+      painter.drawPolyline(points.constData(), 2*columns);
+      painter.setPen(QColor(Qt::gray));
+      painter.drawText(LABELWIDTH - 56, top + 10, QString::number(high));
+      painter.drawText(LABELWIDTH - 56, bottom, QString::number(low));
+    }
+    painter.setPen(QColor(Qt::black));
+    painter.drawText(LABELWIDTH, height() - 4,
+                     QString("%1 s").arg(history.duration(), 0, 'f', 0));
+  }
+
+public:
+
+  PlotPanel(Recorder* r, Idiom* i)
+    : recorder(r), idiom(i), history(Recorder::CHANNELS), painted(-1) {
+    timer = new QTimer(this);
+    setMinimumSize(640, 26*Recorder::CHANNELS + 20);
+    refreshIdiom();
+    connect(timer,SIGNAL(timeout()),this,SLOT(refresh()));
+  }
+
+  ~PlotPanel() {
+    recorder->setHistory(NULL);
+  }
+
+  void refreshIdiom() {
+    setWindowTitle(idiom->text(TXT_MENUPLOTS));
+  }
+
+public slots:
+
+  /** ----------------------------------------------------------------------
+   * @brief refresh method ask a repaint when there are new samples.
+   */
+  void refresh() {
+    if (history.changes() != painted) update();
+  }
+};
+
+#endif // PLOT_H
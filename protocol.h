@@ -0,0 +1,817 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+typedef unsigned char byte;
+
+#include <stdint.h>
+#include <string.h>
+
+/** ========================================================================
+ * @brief Sizes of a Bluetooth telegram.  The brick accepts at most 64 bytes
+ * of command, and every telegram is preceded by two bytes of length
+ * (little endian).
+ */
+enum telegramsize {
+  MAXCOMMAND = 64,
+  MAXTELEGRAM = MAXCOMMAND + 2
+};
+
+/** ========================================================================
+ * @brief First byte of every command and reply (NXT Bluetooth Developer
+ * Kit, appendix 1 and 2).
+ */
+enum commandtype {
+  DIRECTREPLY   = 0x00,
+  SYSTEMREPLY   = 0x01,
+  REPLY         = 0x02,
+  DIRECTNOREPLY = 0x80,
+  SYSTEMNOREPLY = 0x81
+};
+
+/** ========================================================================
+ * @brief Second byte of every command, all direct and system commands
+ * described in the NXT Bluetooth Developer Kit.
+ */
+enum opcode {
+  // Direct commands
+  OP_STARTPROGRAM          = 0x00,
+  OP_STOPPROGRAM           = 0x01,
+  OP_PLAYSOUNDFILE         = 0x02,
+  OP_PLAYTONE              = 0x03,
+  OP_SETOUTPUTSTATE        = 0x04,
+  OP_SETINPUTMODE          = 0x05,
+  OP_GETOUTPUTSTATE        = 0x06,
+  OP_GETINPUTVALUES        = 0x07,
+  OP_RESETINPUTSCALEDVALUE = 0x08,
+  OP_MESSAGEWRITE          = 0x09,
+  OP_RESETMOTORPOSITION    = 0x0A,
+  OP_GETBATTERYLEVEL       = 0x0B,
+  OP_STOPSOUNDPLAYBACK     = 0x0C,
+  OP_KEEPALIVE             = 0x0D,
+  OP_LSGETSTATUS           = 0x0E,
+  OP_LSWRITE               = 0x0F,
+  OP_LSREAD                = 0x10,
+  OP_GETCURRENTPROGRAMNAME = 0x11,
+  OP_MESSAGEREAD           = 0x13,
+
+  // System commands
+  OP_OPENREAD              = 0x80,
+  OP_OPENWRITE             = 0x81,
+  OP_READ                  = 0x82,
+  OP_WRITE                 = 0x83,
+  OP_CLOSE                 = 0x84,
+  OP_DELETE                = 0x85,
+  OP_FINDFIRST             = 0x86,
+  OP_FINDNEXT              = 0x87,
+  OP_GETFIRMWAREVERSION    = 0x88,
+  OP_OPENWRITELINEAR       = 0x89,
+  OP_OPENREADLINEAR        = 0x8A,
+  OP_OPENWRITEDATA         = 0x8B,
+  OP_OPENAPPENDDATA        = 0x8C,
+  OP_REQUESTFIRSTMODULE    = 0x90,
+  OP_REQUESTNEXTMODULE     = 0x91,
+  OP_CLOSEMODULEHANDLE     = 0x92,
+  OP_READIOMAP             = 0x94,
+  OP_WRITEIOMAP            = 0x95,
+  OP_BOOTCOMMAND           = 0x97,
+  OP_SETBRICKNAME          = 0x98,
+  OP_GETDEVICEINFO         = 0x9B,
+  OP_DELETEUSERFLASH       = 0xA0,
+  OP_POLLCOMMANDLENGTH     = 0xA1,
+  OP_POLLCOMMAND           = 0xA2,
+  OP_BLUETOOTHFACTORYRESET = 0xA4
+};
+
+/** ========================================================================
+ * @brief Status byte of replies.  Zero is success, the rest are the error
+ * codes of direct commands (0x20..0xFF) and system commands (0x81..0x93).
+ */
+enum replystatus {
+  STATUS_SUCCESS          = 0x00,
+  STATUS_PENDING          = 0x20,
+  STATUS_QUEUEEMPTY       = 0x40,
+  STATUS_NOMOREHANDLES    = 0x81,
+  STATUS_NOSPACE          = 0x82,
+  STATUS_NOMOREFILES      = 0x83,
+  STATUS_ENDOFFILEEXPECTED= 0x84,
+  STATUS_ENDOFFILE        = 0x85,
+  STATUS_NOTLINEARFILE    = 0x86,
+  STATUS_FILENOTFOUND     = 0x87,
+  STATUS_HANDLECLOSED     = 0x88,
+  STATUS_NOLINEARSPACE    = 0x89,
+  STATUS_UNDEFINED        = 0x8A,
+  STATUS_FILEBUSY         = 0x8B,
+  STATUS_NOWRITEBUFFERS   = 0x8C,
+  STATUS_APPENDIMPOSSIBLE = 0x8D,
+  STATUS_FILEFULL         = 0x8E,
+  STATUS_FILEEXISTS       = 0x8F,
+  STATUS_MODULENOTFOUND   = 0x90,
+  STATUS_OUTOFBOUNDARY    = 0x91,
+  STATUS_ILLEGALFILENAME  = 0x92,
+  STATUS_ILLEGALHANDLE    = 0x93,
+  STATUS_REQUESTFAILED    = 0xBD,
+  STATUS_UNKNOWNOPCODE    = 0xBE,
+  STATUS_INSANEPACKET     = 0xBF,
+  STATUS_OUTOFRANGE       = 0xC0,
+  STATUS_BUSERROR         = 0xDD,
+  STATUS_NOFREEMEMORY     = 0xDE,
+  STATUS_CONNECTIONINVALID= 0xDF,
+  STATUS_CONNECTIONBUSY   = 0xE0,
+  STATUS_NOACTIVEPROGRAM  = 0xEC,
+  STATUS_ILLEGALSIZE      = 0xED,
+  STATUS_ILLEGALMAILBOX   = 0xEE,
+  STATUS_INVALIDFIELD     = 0xEF,
+  STATUS_BADINPUTOUTPUT   = 0xF0,
+  STATUS_NOMEMORY         = 0xFB,
+  STATUS_BADARGUMENTS     = 0xFF
+};
+
+/** ========================================================================
+ * @brief Values used by output and input commands.
+ */
+enum outputport {
+  PORT_A = 0x00, PORT_B = 0x01, PORT_C = 0x02, PORT_ALL = 0xFF
+};
+
+enum outputmode {
+  MODE_COAST = 0x00, MODE_MOTORON = 0x01, MODE_BRAKE = 0x02,
+  MODE_REGULATED = 0x04
+};
+
+enum regulationmode {
+  REGULATION_IDLE = 0x00, REGULATION_SPEED = 0x01, REGULATION_SYNC = 0x02
+};
+
+enum runstate {
+  RUNSTATE_IDLE = 0x00, RUNSTATE_RAMPUP = 0x10, RUNSTATE_RUNNING = 0x20,
+  RUNSTATE_RAMPDOWN = 0x40
+};
+
+enum sensortype {
+  SENSOR_NONE = 0x00, SENSOR_SWITCH = 0x01, SENSOR_TEMPERATURE = 0x02,
+  SENSOR_REFLECTION = 0x03, SENSOR_ANGLE = 0x04, SENSOR_LIGHTACTIVE = 0x05,
+  SENSOR_LIGHTINACTIVE = 0x06, SENSOR_SOUNDDB = 0x07,
+  SENSOR_SOUNDDBA = 0x08, SENSOR_CUSTOM = 0x09, SENSOR_LOWSPEED = 0x0A,
+  SENSOR_LOWSPEED9V = 0x0B
+};
+
+enum sensormode {
+  SENSORMODE_RAW = 0x00, SENSORMODE_BOOLEAN = 0x20,
+  SENSORMODE_TRANSITIONCOUNT = 0x40, SENSORMODE_PERIODCOUNT = 0x60,
+  SENSORMODE_PERCENT = 0x80, SENSORMODE_CELSIUS = 0xA0,
+  SENSORMODE_FAHRENHEIT = 0xC0, SENSORMODE_ANGLESTEPS = 0xE0
+};
+
+/** ========================================================================
+ * @brief Widths of the fixed string fields (null terminator included).
+ */
+enum fieldwidth {
+  FILENAMEWIDTH = 20,
+  BRICKNAMEWIDTH = 16,
+  DEVICENAMEWIDTH = 15,
+  ADDRESSWIDTH = 7,
+  LSDATAWIDTH = 16,
+  MESSAGEWIDTH = 59
+};
+
+/** ========================================================================
+ * @brief Packer class serialize a command directly into a buffer given by
+ * the caller, keeping the two bytes of length at beginning.  Nothing is
+ * allocated, when buffer is small the result of finish() is zero.
+ */
+class Packer {
+private:
+  byte* out;
+  int   capacity;
+  int   at;
+public:
+
+  /** ----------------------------------------------------------------------
+   * @brief Packer constructor leave room to length bytes.
+   */
+  Packer(byte* buffer, int count) : out(buffer), capacity(count), at(2) {
+  }
+
+  void put(byte value) {
+    if (at < capacity) out[at] = value;
+    at++;
+  }
+
+  void put16(uint16_t value) {
+    put(value & 0xFF);
+    put(value >> 8);
+  }
+
+  void put32(uint32_t value) {
+    put16(value & 0xFFFF);
+    put16(value >> 16);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief putString method write an ASCIIZ string, padded with zeros until
+   * "width" bytes.  When width is zero, only the string and its null are
+   * written.
+   */
+  void putString(const char* text, int width) {
+    int i = 0;
+    int limit = width>0 ? width-1 : MAXCOMMAND;
+    for (; text && text[i] && i<limit; i++) put(text[i]);
+    if (width == 0) width = i+1;
+    for (; i<width; i++) put(0x00);
+  }
+
+  void putBytes(const byte* pieces, int count) {
+    for (int i=0; i<count; i++) put(pieces[i]);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief finish method write the length bytes.
+   * @return bytes of complete telegram, or zero when it did not fit.
+   */
+  int finish() {
+    if (at > capacity || at-2 > MAXCOMMAND) return 0;
+    out[0] = (at-2) & 0xFF;
+    out[1] = (at-2) >> 8;
+    return at;
+  }
+};
+
+/** ========================================================================
+ * @brief Requests.  Each struct keeps the fields of one command, and
+ * "pack" method put them in the telegram after command type and opcode.
+ * Variable data is referenced, never copied, until the telegram is packed.
+ */
+
+/** ----------------------------------------------------------------------
+ * @brief Command base for all requests without parameters.
+ */
+template <int OPCODE, bool SYSTEM, bool REPLIES>
+struct Simple {
+  enum { opcode = OPCODE, system = SYSTEM, replies = REPLIES };
+  void pack(Packer&) const {}
+};
+
+typedef Simple<OP_STOPPROGRAM,false,false>          StopProgram;
+typedef Simple<OP_STOPSOUNDPLAYBACK,false,false>    StopSoundPlayback;
+typedef Simple<OP_GETBATTERYLEVEL,false,true>       GetBatteryLevel;
+typedef Simple<OP_KEEPALIVE,false,true>             KeepAlive;
+typedef Simple<OP_GETCURRENTPROGRAMNAME,false,true> GetCurrentProgramName;
+typedef Simple<OP_GETFIRMWAREVERSION,true,true>     GetFirmwareVersion;
+typedef Simple<OP_GETDEVICEINFO,true,true>          GetDeviceInfo;
+typedef Simple<OP_DELETEUSERFLASH,true,true>        DeleteUserFlash;
+typedef Simple<OP_BLUETOOTHFACTORYRESET,true,true>  BluetoothFactoryReset;
+
+/** ----------------------------------------------------------------------
+ * @brief Command base for all requests with only one filename.
+ */
+template <int OPCODE, bool SYSTEM, bool REPLIES>
+struct Named {
+  enum { opcode = OPCODE, system = SYSTEM, replies = REPLIES };
+  const char* filename;
+  Named(const char* name) : filename(name) {}
+  void pack(Packer& p) const { p.putString(filename,FILENAMEWIDTH); }
+};
+
+typedef Named<OP_STARTPROGRAM,false,false>      StartProgram;
+typedef Named<OP_OPENREAD,true,true>            OpenRead;
+typedef Named<OP_DELETE,true,true>              Delete;
+typedef Named<OP_FINDFIRST,true,true>           FindFirst;
+typedef Named<OP_OPENREADLINEAR,true,true>      OpenReadLinear;
+typedef Named<OP_OPENAPPENDDATA,true,true>      OpenAppendData;
+typedef Named<OP_REQUESTFIRSTMODULE,true,true>  RequestFirstModule;
+
+/** ----------------------------------------------------------------------
+ * @brief Command base for all requests with a filename and its size.
+ */
+template <int OPCODE>
+struct Sized {
+  enum { opcode = OPCODE, system = true, replies = true };
+  const char* filename;
+  uint32_t    size;
+  Sized(const char* name, uint32_t bytes) : filename(name), size(bytes) {}
+  void pack(Packer& p) const {
+    p.putString(filename,FILENAMEWIDTH);
+    p.put32(size);
+  }
+};
+
+typedef Sized<OP_OPENWRITE>       OpenWrite;
+typedef Sized<OP_OPENWRITELINEAR> OpenWriteLinear;
+typedef Sized<OP_OPENWRITEDATA>   OpenWriteData;
+
+/** ----------------------------------------------------------------------
+ * @brief Command base for all requests with only one byte of parameter
+ * (port, handle or buffer number).
+ */
+template <int OPCODE, bool SYSTEM, bool REPLIES>
+struct Single {
+  enum { opcode = OPCODE, system = SYSTEM, replies = REPLIES };
+  byte value;
+  Single(byte v) : value(v) {}
+  void pack(Packer& p) const { p.put(value); }
+};
+
+typedef Single<OP_GETOUTPUTSTATE,false,true>         GetOutputState;
+typedef Single<OP_GETINPUTVALUES,false,true>         GetInputValues;
+typedef Single<OP_RESETINPUTSCALEDVALUE,false,false> ResetInputScaledValue;
+typedef Single<OP_LSGETSTATUS,false,true>            LSGetStatus;
+typedef Single<OP_LSREAD,false,true>                 LSRead;
+typedef Single<OP_CLOSE,true,true>                   Close;
+typedef Single<OP_FINDNEXT,true,true>                FindNext;
+typedef Single<OP_REQUESTNEXTMODULE,true,true>       RequestNextModule;
+typedef Single<OP_CLOSEMODULEHANDLE,true,true>       CloseModuleHandle;
+typedef Single<OP_POLLCOMMANDLENGTH,true,true>       PollCommandLength;
+
+struct PlaySoundFile {
+  enum { opcode = OP_PLAYSOUNDFILE, system = false, replies = false };
+  bool        loop;
+  const char* filename;
+  PlaySoundFile(const char* name, bool repeat=false)
+    : loop(repeat), filename(name) {}
+  void pack(Packer& p) const {
+    p.put(loop);
+    p.putString(filename,FILENAMEWIDTH);
+  }
+};
+
+struct PlayTone {
+  enum { opcode = OP_PLAYTONE, system = false, replies = false };
+  uint16_t frequency;   // Hz, 200..14000
+  uint16_t duration;    // ms
+  PlayTone(uint16_t hz, uint16_t ms) : frequency(hz), duration(ms) {}
+  void pack(Packer& p) const {
+    p.put16(frequency);
+    p.put16(duration);
+  }
+};
+
+struct SetOutputState {
+  enum { opcode = OP_SETOUTPUTSTATE, system = false, replies = false };
+  byte        port;
+  signed char power;    // -100..100
+  byte        mode;
+  byte        regulation;
+  signed char turnRatio;
+  byte        runState;
+  uint32_t    tachoLimit;
+  SetOutputState(byte p, signed char pw, byte m=MODE_MOTORON,
+                 byte r=REGULATION_IDLE, signed char turn=0,
+                 byte run=RUNSTATE_RUNNING, uint32_t limit=0)
+    : port(p), power(pw), mode(m), regulation(r), turnRatio(turn),
+      runState(run), tachoLimit(limit) {}
+  void pack(Packer& p) const {
+    p.put(port);
+    p.put(power);
+    p.put(mode);
+    p.put(regulation);
+    p.put(turnRatio);
+    p.put(runState);
+    p.put32(tachoLimit);
+  }
+};
+
+struct SetInputMode {
+  enum { opcode = OP_SETINPUTMODE, system = false, replies = false };
+  byte port;
+  byte type;
+  byte mode;
+  SetInputMode(byte p, byte t, byte m) : port(p), type(t), mode(m) {}
+  void pack(Packer& p) const {
+    p.put(port);
+    p.put(type);
+    p.put(mode);
+  }
+};
+
+struct MessageWrite {
+  enum { opcode = OP_MESSAGEWRITE, system = false, replies = false };
+  byte        inbox;
+  const byte* message;
+  byte        size;     // null terminator included
+  MessageWrite(byte box, const byte* data, byte count)
+    : inbox(box), message(data), size(count) {}
+  void pack(Packer& p) const {
+    p.put(inbox);
+    p.put(size);
+    p.putBytes(message,size);
+  }
+};
+
+struct ResetMotorPosition {
+  enum { opcode = OP_RESETMOTORPOSITION, system = false, replies = false };
+  byte port;
+  bool relative;
+  ResetMotorPosition(byte p, bool r) : port(p), relative(r) {}
+  void pack(Packer& p) const {
+    p.put(port);
+    p.put(relative);
+  }
+};
+
+struct LSWrite {
+  enum { opcode = OP_LSWRITE, system = false, replies = false };
+  byte        port;
+  const byte* data;
+  byte        txLength;
+  byte        rxLength;
+  LSWrite(byte p, const byte* tx, byte txCount, byte rxCount)
+    : port(p), data(tx), txLength(txCount), rxLength(rxCount) {}
+  void pack(Packer& p) const {
+    p.put(port);
+    p.put(txLength);
+    p.put(rxLength);
+    p.putBytes(data,txLength);
+  }
+};
+
+struct MessageRead {
+  enum { opcode = OP_MESSAGEREAD, system = false, replies = true };
+  byte remoteInbox;
+  byte localInbox;
+  bool remove;
+  MessageRead(byte remote, byte local, bool r)
+    : remoteInbox(remote), localInbox(local), remove(r) {}
+  void pack(Packer& p) const {
+    p.put(remoteInbox);
+    p.put(localInbox);
+    p.put(remove);
+  }
+};
+
+struct Read {
+  enum { opcode = OP_READ, system = true, replies = true };
+  byte     handle;
+  uint16_t count;
+  Read(byte h, uint16_t bytes) : handle(h), count(bytes) {}
+  void pack(Packer& p) const {
+    p.put(handle);
+    p.put16(count);
+  }
+};
+
+struct Write {
+  enum { opcode = OP_WRITE, system = true, replies = true };
+  byte        handle;
+  const byte* data;
+  int         count;
+  Write(byte h, const byte* d, int bytes) : handle(h), data(d), count(bytes) {}
+  void pack(Packer& p) const {
+    p.put(handle);
+    p.putBytes(data,count);
+  }
+};
+
+struct ReadIOMap {
+  enum { opcode = OP_READIOMAP, system = true, replies = true };
+  uint32_t module;
+  uint16_t offset;
+  uint16_t count;
+  ReadIOMap(uint32_t id, uint16_t from, uint16_t bytes)
+    : module(id), offset(from), count(bytes) {}
+  void pack(Packer& p) const {
+    p.put32(module);
+    p.put16(offset);
+    p.put16(count);
+  }
+};
+
+struct WriteIOMap {
+  enum { opcode = OP_WRITEIOMAP, system = true, replies = true };
+  uint32_t    module;
+  uint16_t    offset;
+  const byte* data;
+  uint16_t    count;
+  WriteIOMap(uint32_t id, uint16_t from, const byte* d, uint16_t bytes)
+    : module(id), offset(from), data(d), count(bytes) {}
+  void pack(Packer& p) const {
+    p.put32(module);
+    p.put16(offset);
+    p.put16(count);
+    p.putBytes(data,count);
+  }
+};
+
+struct BootCommand {
+  enum { opcode = OP_BOOTCOMMAND, system = true, replies = true };
+  void pack(Packer& p) const { p.putString("Let's dance: SAMBA",0); }
+};
+
+struct SetBrickName {
+  enum { opcode = OP_SETBRICKNAME, system = true, replies = true };
+  const char* name;
+  SetBrickName(const char* n) : name(n) {}
+  void pack(Packer& p) const { p.putString(name,BRICKNAMEWIDTH); }
+};
+
+struct PollCommand {
+  enum { opcode = OP_POLLCOMMAND, system = true, replies = true };
+  byte buffer;
+  byte count;
+  PollCommand(byte b, byte bytes) : buffer(b), count(bytes) {}
+  void pack(Packer& p) const {
+    p.put(buffer);
+    p.put(count);
+  }
+};
+
+/** ----------------------------------------------------------------------
+ * @brief encode function serialize a request in "buffer", length bytes
+ * included, asking reply or not to brick.
+ * @return size of telegram, or zero when "buffer" is small.
+ */
+template <class Request>
+int encode(const Request& request, byte* buffer, int count,
+           bool reply = Request::replies) {
+  Packer p(buffer,count);
+  if (Request::system) p.put(reply ? SYSTEMREPLY : SYSTEMNOREPLY);
+  else                 p.put(reply ? DIRECTREPLY : DIRECTNOREPLY);
+  p.put(Request::opcode);
+  request.pack(p);
+  return p.finish();
+}
+
+/** ----------------------------------------------------------------------
+ * @brief telegramLength function look at the length bytes of a received
+ * stream.
+ * @return size of first complete telegram in "buffer" (length bytes
+ * included), or zero when there are not enough bytes yet.
+ */
+inline int telegramLength(const byte* buffer, int count) {
+  if (count < 2) return 0;
+  int size = 2 + (buffer[0] | (buffer[1] << 8));
+  return size <= count ? size : 0;
+}
+
+/** ========================================================================
+ * @brief Reply class is a view over a received telegram (without the length
+ * bytes).  It never copies, so the buffer must live while the view is
+ * used.  Specialized replies only add accessors to their fields.
+ */
+class Reply {
+protected:
+  const byte* data;
+  int         size;
+
+  byte     u8(int at)  const { return data[at]; }
+  int8_t   s8(int at)  const { return (int8_t)data[at]; }
+  uint16_t u16(int at) const { return data[at] | (data[at+1] << 8); }
+  int16_t  s16(int at) const { return (int16_t)u16(at); }
+  uint32_t u32(int at) const { return u16(at) | ((uint32_t)u16(at+2) << 16); }
+  int32_t  s32(int at) const { return (int32_t)u32(at); }
+  const char* text(int at) const { return (const char*)data+at; }
+
+public:
+  Reply(const byte* body, int count) : data(body), size(count) {
+  }
+
+  byte command() const { return data[1]; }
+  byte status()  const { return data[2]; }
+  int  length()  const { return size; }
+
+  /** ----------------------------------------------------------------------
+   * @brief valid method check reply is of the "op" command and carries at
+   * least "needed" bytes.
+   */
+  bool valid(byte op, int needed = 3) const {
+    return size >= 3 && data[0] == REPLY && data[1] == op &&
+           (data[2] != STATUS_SUCCESS || size >= needed);
+  }
+
+  bool ok() const { return size >= 3 && data[0] == REPLY && data[2] == 0; }
+};
+
+struct OutputStateReply : public Reply {
+  enum { opcode = OP_GETOUTPUTSTATE, needed = 25 };
+  OutputStateReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte     port()             const { return u8(3); }
+  int8_t   power()            const { return s8(4); }
+  byte     mode()             const { return u8(5); }
+  byte     regulation()       const { return u8(6); }
+  int8_t   turnRatio()        const { return s8(7); }
+  byte     runState()         const { return u8(8); }
+  uint32_t tachoLimit()       const { return u32(9); }
+  int32_t  tachoCount()       const { return s32(13); }
+  int32_t  blockTachoCount()  const { return s32(17); }
+  int32_t  rotationCount()    const { return s32(21); }
+};
+
+struct InputValuesReply : public Reply {
+  enum { opcode = OP_GETINPUTVALUES, needed = 16 };
+  InputValuesReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte     port()             const { return u8(3); }
+  bool     validData()        const { return u8(4); }
+  bool     calibrated()       const { return u8(5); }
+  byte     type()             const { return u8(6); }
+  byte     mode()             const { return u8(7); }
+  uint16_t raw()              const { return u16(8); }
+  uint16_t normalized()       const { return u16(10); }
+  int16_t  scaled()           const { return s16(12); }
+  int16_t  calibratedValue()  const { return s16(14); }
+};
+
+struct BatteryLevelReply : public Reply {
+  enum { opcode = OP_GETBATTERYLEVEL, needed = 5 };
+  BatteryLevelReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  uint16_t millivolts() const { return u16(3); }
+};
+
+struct KeepAliveReply : public Reply {
+  enum { opcode = OP_KEEPALIVE, needed = 7 };
+  KeepAliveReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  uint32_t sleepTime() const { return u32(3); }
+};
+
+struct LSStatusReply : public Reply {
+  enum { opcode = OP_LSGETSTATUS, needed = 4 };
+  LSStatusReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte bytesReady() const { return u8(3); }
+};
+
+struct LSReadReply : public Reply {
+  enum { opcode = OP_LSREAD, needed = 4 + LSDATAWIDTH };
+  LSReadReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte        bytesRead() const { return u8(3); }
+  const byte* rxData()    const { return data+4; }
+};
+
+struct ProgramNameReply : public Reply {
+  enum { opcode = OP_GETCURRENTPROGRAMNAME, needed = 3 + FILENAMEWIDTH };
+  ProgramNameReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  const char* filename() const { return text(3); }
+};
+
+struct MessageReadReply : public Reply {
+  enum { opcode = OP_MESSAGEREAD, needed = 5 + MESSAGEWIDTH };
+  MessageReadReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte        localInbox() const { return u8(3); }
+  byte        size()       const { return u8(4); }
+  const byte* message()    const { return data+5; }
+};
+
+/** ----------------------------------------------------------------------
+ * @brief Reply of OPEN WRITE, OPEN WRITE LINEAR, OPEN WRITE DATA, CLOSE and
+ * CLOSE MODULE HANDLE, all of them carry only the handle.
+ */
+struct HandleReply : public Reply {
+  enum { needed = 4 };
+  HandleReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid(byte op) const { return Reply::valid(op,needed); }
+  byte handle() const { return u8(3); }
+};
+
+/** ----------------------------------------------------------------------
+ * @brief Reply of OPEN READ and OPEN APPEND DATA: handle and a size (file
+ * size or available size respectively).
+ */
+struct OpenReply : public Reply {
+  enum { needed = 8 };
+  OpenReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid(byte op) const { return Reply::valid(op,needed); }
+  byte     handle() const { return u8(3); }
+  uint32_t size()   const { return u32(4); }
+};
+
+struct ReadReply : public Reply {
+  enum { opcode = OP_READ, needed = 6 };
+  ReadReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const {
+    return Reply::valid(opcode,needed) && (!ok() || size >= 6 + count());
+  }
+  byte        handle() const { return u8(3); }
+  uint16_t    count()  const { return u16(4); }
+  const byte* bytes()  const { return data+6; }
+};
+
+struct WriteReply : public Reply {
+  enum { opcode = OP_WRITE, needed = 6 };
+  WriteReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte     handle()  const { return u8(3); }
+  uint16_t written() const { return u16(4); }
+};
+
+struct DeleteReply : public Reply {
+  enum { opcode = OP_DELETE, needed = 3 + FILENAMEWIDTH };
+  DeleteReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  const char* filename() const { return text(3); }
+};
+
+/** ----------------------------------------------------------------------
+ * @brief Reply of FIND FIRST and FIND NEXT.
+ */
+struct FindReply : public Reply {
+  enum { needed = 8 + FILENAMEWIDTH };
+  FindReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const {
+    return Reply::valid(OP_FINDFIRST,needed) ||
+           Reply::valid(OP_FINDNEXT,needed);
+  }
+  byte        handle()   const { return u8(3); }
+  const char* filename() const { return text(4); }
+  uint32_t    fileSize() const { return u32(4+FILENAMEWIDTH); }
+};
+
+struct FirmwareVersionReply : public Reply {
+  enum { opcode = OP_GETFIRMWAREVERSION, needed = 7 };
+  FirmwareVersionReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte protocolMinor() const { return u8(3); }
+  byte protocolMajor() const { return u8(4); }
+  byte firmwareMinor() const { return u8(5); }
+  byte firmwareMajor() const { return u8(6); }
+};
+
+struct OpenReadLinearReply : public Reply {
+  enum { opcode = OP_OPENREADLINEAR, needed = 7 };
+  OpenReadLinearReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  uint32_t pointer() const { return u32(3); }
+};
+
+/** ----------------------------------------------------------------------
+ * @brief Reply of REQUEST FIRST MODULE and REQUEST NEXT MODULE.
+ */
+struct ModuleReply : public Reply {
+  enum { needed = 14 + FILENAMEWIDTH };
+  ModuleReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const {
+    return Reply::valid(OP_REQUESTFIRSTMODULE,needed) ||
+           Reply::valid(OP_REQUESTNEXTMODULE,needed);
+  }
+  byte        handle()    const { return u8(3); }
+  const char* name()      const { return text(4); }
+  uint32_t    module()    const { return u32(4+FILENAMEWIDTH); }
+  uint32_t    size()      const { return u32(8+FILENAMEWIDTH); }
+  uint16_t    ioMapSize() const { return u16(12+FILENAMEWIDTH); }
+};
+
+struct ReadIOMapReply : public Reply {
+  enum { opcode = OP_READIOMAP, needed = 9 };
+  ReadIOMapReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const {
+    return Reply::valid(opcode,needed) && (!ok() || size >= 9 + count());
+  }
+  uint32_t    module() const { return u32(3); }
+  uint16_t    count()  const { return u16(7); }
+  const byte* bytes()  const { return data+9; }
+};
+
+struct WriteIOMapReply : public Reply {
+  enum { opcode = OP_WRITEIOMAP, needed = 9 };
+  WriteIOMapReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  uint32_t module()  const { return u32(3); }
+  uint16_t written() const { return u16(7); }
+};
+
+struct BootReply : public Reply {
+  enum { opcode = OP_BOOTCOMMAND, needed = 7 };
+  BootReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  const char* answer() const { return text(3); }
+};
+
+struct DeviceInfoReply : public Reply {
+  enum { opcode = OP_GETDEVICEINFO,
+         needed = 11 + DEVICENAMEWIDTH + ADDRESSWIDTH };
+  DeviceInfoReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  const char* name()    const { return text(3); }
+  const byte* address() const { return data+3+DEVICENAMEWIDTH; }
+  uint32_t    signal()  const {
+    return u32(3+DEVICENAMEWIDTH+ADDRESSWIDTH);
+  }
+  uint32_t    freeFlash() const {
+    return u32(7+DEVICENAMEWIDTH+ADDRESSWIDTH);
+  }
+};
+
+struct PollLengthReply : public Reply {
+  enum { opcode = OP_POLLCOMMANDLENGTH, needed = 5 };
+  PollLengthReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const { return Reply::valid(opcode,needed); }
+  byte buffer() const { return u8(3); }
+  byte count()  const { return u8(4); }
+};
+
+struct PollReply : public Reply {
+  enum { opcode = OP_POLLCOMMAND, needed = 5 };
+  PollReply(const byte* b, int n) : Reply(b,n) {}
+  bool valid() const {
+    return Reply::valid(opcode,needed) && (!ok() || size >= 5 + count());
+  }
+  byte        buffer()  const { return u8(3); }
+  byte        count()   const { return u8(4); }
+  const byte* command() const { return data+5; }
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,270 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QString>
+
+#include <network.h>
+#include <telemetry.h>
+#include <history.h>
+#include <segment.h>
+
+/** ========================================================================
+ * @brief Recorder class poll sensors, motors and battery of brick and give
+ * every sample to a telemetry file (see telemetry.h), to a History for
+ * plots and to the shared segment of other processes (see segment.h), all
+ * of them optional.  Each tick takes the last values received
+ * and asks new ones; requests are pipelined and a tick does not ask again
+ * while too many replies are missing, so polling goes as fast as the link
+ * allows.  Thread runs only when brick is connected and somebody wants the
+ * samples.
+ */
+class Recorder : public QThread, public ReplyHandler {
+public:
+  enum {
+    RATE     = 20,          // ticks per second
+    INPUTS   = 4,
+    MOTORS   = 3,
+    BATTERY  = INPUTS*2 + MOTORS*3,
+    CHANNELS = BATTERY + 1,
+    REQUESTS = INPUTS + MOTORS,
+    COMMIT   = RATE         // ticks between commits
+  };
+
+private:
+  Network*         net;
+  TelemetryWriter  writer;
+  QMutex           lock;
+  QMutex           filing;   // writer
+  QMutex           plotting; // history, with lock to change it
+  QAtomicInt       running;
+  QAtomicInt       opened;   // writer is open, read without filing
+  int32_t          latest[CHANNELS];
+  int              waiting;  // requests without reply yet
+  qint64           fileStart;
+  History*         history;
+  SetpointSegment* segment;
+  bool             attached;
+
+  /** ----------------------------------------------------------------------
+   * @brief poll method ask the values of a tick, battery once a second.
+   */
+  void poll(int tick) {
+    {
+      QMutexLocker locker(&lock);
+      if (waiting > REQUESTS*2) return;
+      waiting += REQUESTS + (tick % RATE == 0 ? 1 : 0);
+    }
+    int lost = 0;
+    for (byte port=0; port<INPUTS; port++) {
+      if (!net->request(Telegram(GetInputValues(port)), this,
+                        Network::BULK)) {
+        lost++;
+      }
+    }
+    for (byte port=PORT_A; port<MOTORS; port++) {
+      if (!net->request(Telegram(GetOutputState(port)), this,
+                        Network::BULK)) {
+        lost++;
+      }
+    }
+    if (tick % RATE == 0 &&
+        !net->request(Telegram(GetBatteryLevel()), this, Network::BULK)) {
+      lost++;
+    }
+    QMutexLocker locker(&lock);
+    waiting -= lost;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief engage method start or stop the thread, as Controller does.
+   */
+  void engage() {
+    bool wanted;
+    {
+      QMutexLocker locker(&lock);
+      wanted = attached && (opened.load() || history || segment);
+    }
+    if (wanted && !isRunning()) {
+      memset(latest, 0, sizeof(latest));
+      waiting = 0;
+      running.store(1);
+      start();
+    }
+    else if (!wanted && isRunning()) {
+      running.store(0);
+      wait();
+      net->forget(this);
+    }
+  }
+
+protected:
+
+  /** ----------------------------------------------------------------------
+   * @brief run method tick at RATE with absolute deadlines, as Controller.
+   */
+  void run() {
+    qint64 deadline = monotonic();
+    qint64 period = 1000000000LL / RATE;
+    int32_t row[CHANNELS];
+    for (int tick=0; running.load(); tick++) {
+      poll(tick);
+      deadline += period;
+      struct timespec wake;
+      wake.tv_sec  = deadline / 1000000000LL;
+      wake.tv_nsec = deadline % 1000000000LL;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+
+      qint64 now = monotonic();
+      lock.lock();
+      memcpy(row, latest, sizeof(row));
+      if (segment) segment->publish(now, row, CHANNELS);
+      lock.unlock();
+      plotting.lock();
+      if (history) history->append(now, row);
+      plotting.unlock();
+      filing.lock();
+      if (writer.isOpen()) {
+        writer.append(now - fileStart, row);
+        if (tick % COMMIT == COMMIT-1) writer.commit();
+      }
+      filing.unlock();
+      if (now - deadline > period) deadline = now;
+    }
+  }
+
+public:
+
+  Recorder(Network* n)
+    : net(n), running(0), opened(0), waiting(0), fileStart(0),
+      history(NULL), segment(NULL), attached(false) {
+  }
+
+  ~Recorder() {
+    setAttached(false);
+    stopRecording();
+  }
+
+  static const char* const* names() {
+    static const char* const list[CHANNELS] = {
+      "s1.raw", "s1.scaled", "s2.raw", "s2.scaled",
+      "s3.raw", "s3.scaled", "s4.raw", "s4.scaled",
+      "a.power", "a.tacho", "a.rotation",
+      "b.power", "b.tacho", "b.rotation",
+      "c.power", "c.tacho", "c.rotation",
+      "battery.mv"
+    };
+    return list;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief record method create the file and write samples on it.
+   */
+  bool record(QString fileName) {
+    {
+      QMutexLocker locker(&filing);
+      if (writer.isOpen()) return false;
+      struct timespec now;
+      clock_gettime(CLOCK_REALTIME, &now);
+      if (!writer.create(fileName.toStdString().c_str(), names(), CHANNELS,
+                         (qint64)now.tv_sec*1000000000LL + now.tv_nsec)) {
+        return false;
+      }
+      fileStart = monotonic();
+      opened.store(1);
+    }
+    engage();
+    return true;
+  }
+
+  void stopRecording() {
+    {
+      QMutexLocker locker(&filing);
+      writer.close();
+      opened.store(0);
+    }
+    engage();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief recording method tell if a file is open, without waiting the
+   * recorder thread while it commits the file.
+   */
+  bool recording() {
+    return opened.load();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setHistory method give samples also to "h", NULL to stop.  On
+   * return, previous history is not used anymore.  Samples are appended
+   * under "plotting" and not "lock", so replies are not delayed.
+   */
+  void setHistory(History* h) {
+    {
+      QMutexLocker locker(&plotting);
+      QMutexLocker other(&lock);
+      history = h;
+    }
+    engage();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setSegment method publish samples also in "s", NULL to stop.  On
+   * return, "s" is not used anymore.
+   */
+  void setSegment(SetpointSegment* s) {
+    {
+      QMutexLocker locker(&lock);
+      segment = s;
+    }
+    engage();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setAttached method tell recorder if brick is connected, it must
+   * be called before Network::unbind.  File is closed on disconnection.
+   */
+  void setAttached(bool on) {
+    attached = on;
+    engage();
+    if (!on) stopRecording();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief replied method keep the values of sensors, motors and battery,
+   * a lost reply only frees its place.
+   */
+  void replied(const byte* bytes, int count) {
+    Reply reply(bytes, count);
+    QMutexLocker locker(&lock);
+    if (waiting > 0) waiting--;
+    if (!bytes || !reply.valid(reply.command()) || !reply.ok()) return;
+    switch (reply.command()) {
+      case OP_GETINPUTVALUES: {
+        InputValuesReply input(bytes, count);
+        if (!input.valid() || input.port() >= INPUTS) break;
+        latest[2*input.port()]   = input.raw();
+        latest[2*input.port()+1] = input.scaled();
+        break;
+      }
+      case OP_GETOUTPUTSTATE: {
+        OutputStateReply output(bytes, count);
+        if (!output.valid() || output.port() >= MOTORS) break;
+        latest[INPUTS*2 + 3*output.port()]   = output.power();
+        latest[INPUTS*2 + 3*output.port()+1] = output.tachoCount();
+        latest[INPUTS*2 + 3*output.port()+2] = output.rotationCount();
+        break;
+      }
+      case OP_GETBATTERYLEVEL: {
+        BatteryLevelReply battery(bytes, count);
+        if (battery.valid()) latest[BATTERY] = battery.millivolts();
+        break;
+      }
+    }
+  }
+};
+
+#endif // RECORDER_H
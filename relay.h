@@ -0,0 +1,520 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QString>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+
+#include <network.h>
+
+/** ========================================================================
+ * @brief Relay class owns the Bluetooth connection with one brick and
+ * shares it with many local clients (TCP on loopback and Unix socket).
+ * Clients talk the same framing of Bluetooth: two bytes of length and the
+ * command.  Telegrams are taken one per client in round robin, and replies
+ * go back to the client that asked them, because brick answers in order.
+ * A client that closes its side is kept until its telegrams are sent and
+ * its replies are given.  Everything runs in one thread with epoll.
+ */
+class Relay {
+public:
+  enum {
+    RELAYPORT    = 9027,
+    CLIENTQUEUE  = 16,      // telegrams waiting per client
+    CLIENTINPUT  = 1024,    // bytes not yet split in telegrams
+    CLIENTOUTPUT = 4096,    // replies not yet read by client
+    LINKOUTPUT   = 1024,    // bytes not yet accepted by RFCOMM socket
+    WINDOW       = 8,       // replies in flight on the link
+    MAXEVENTS    = 256
+  };
+
+private:
+  enum { LINK = 0, TCP = 1, UNIX = 2, FIRSTCLIENT = 16 };
+
+  struct Frame {
+    byte   bytes[MAXTELEGRAM];
+    int    size;
+    qint64 at;              // when it was queued (ns)
+  };
+
+  struct Client {
+    int   id;
+    int   fd;
+    byte  input[CLIENTINPUT];
+    int   inputSize;
+    Frame queue[CLIENTQUEUE];
+    int   head;
+    int   count;
+    byte  output[CLIENTOUTPUT];
+    int   outputSize;
+    int   waiting;          // replies still to come from brick
+    bool  closing;          // client will not send anymore
+    bool  reading;
+    bool  writing;
+  };
+
+  struct Pending {
+    int    client;
+    byte   opcode;
+  };
+
+  int                  epoll;
+  int                  link;
+  int                  tcp;
+  int                  local;
+  QString              localPath;
+  int                  nextId;
+  int                  turn;
+  QHash<int,Client*>   clients;
+  QList<Client*>       order;
+  QQueue<Pending>      pending;
+  byte                 linkOutput[LINKOUTPUT];
+  int                  linkOutputSize;
+  byte                 linkInput[MAXTELEGRAM];
+  int                  linkInputSize;
+  bool                 linkWriting;
+  Capture*             capture;
+
+  // statistics since last report
+  qint64               relayed;
+  qint64               replies;
+  qint64               delay;       // sum of queueing delays (ns)
+  qint64               worst;       // worst queueing delay (ns)
+  qint64               reported;
+
+  static void nonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief watch method register or modify "fd" in epoll.
+   */
+  void watch(int fd, quint64 key, bool in, bool out, bool add) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = 0;
+    if (in)  ev.events |= EPOLLIN;
+    if (out) ev.events |= EPOLLOUT;
+    ev.data.u64 = key;
+    epoll_ctl(epoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+  }
+
+  void rewatch(Client* c) {
+    bool in = c->count < CLIENTQUEUE && !c->closing;
+    bool out = c->outputSize > 0;
+    if (in == c->reading && out == c->writing) return;
+    c->reading = in;
+    c->writing = out;
+    watch(c->fd, c->id, in, out, false);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief listenTcp method open the TCP port, only on loopback.
+   */
+  int listenTcp(int port) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    int yes = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(s, SOMAXCONN) < 0) {
+      close(s);
+      return -1;
+    }
+    nonBlocking(s);
+    return s;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief connectUnix method open the Unix socket of a brick stand-in
+   * (see tools/relayload.cpp), used instead of RFCOMM for load tests.
+   */
+  static int connectUnix(QString path) {
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.toStdString().c_str(),
+            sizeof(addr.sun_path)-1);
+    if (::connect(s, (struct sockaddr*)&addr, sizeof(addr)) == 0) return s;
+    close(s);
+    return -1;
+  }
+
+  int listenUnix(QString path) {
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.toStdString().c_str(),
+            sizeof(addr.sun_path)-1);
+    unlink(addr.sun_path);
+    if (::bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(s, SOMAXCONN) < 0) {
+      close(s);
+      return -1;
+    }
+    nonBlocking(s);
+    return s;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief accept method take all clients waiting in a listening socket.
+   */
+  void acceptClients(int listener) {
+    for (;;) {
+      int fd = accept(listener, NULL, NULL);
+      if (fd < 0) return;
+      nonBlocking(fd);
+      int yes = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+      Client* c = new Client;
+      c->id = nextId++;
+      c->fd = fd;
+      c->inputSize = 0;
+      c->head = 0;
+      c->count = 0;
+      c->outputSize = 0;
+      c->waiting = 0;
+      c->closing = false;
+      c->reading = true;
+      c->writing = false;
+      clients.insert(c->id, c);
+      order.append(c);
+      watch(fd, c->id, true, false, true);
+    }
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief done method tell if a client that closed its side got all.
+   */
+  static bool done(Client* c) {
+    return c->closing && c->count == 0 && c->waiting == 0 &&
+           c->outputSize == 0;
+  }
+
+  void drop(Client* c) {
+    epoll_ctl(epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    int at = order.indexOf(c);
+    order.removeAt(at);
+    if (at < turn) turn--;
+    clients.remove(c->id);
+    delete c;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief split method move complete telegrams of input bytes to the
+   * queue of client.  A client with its queue full is not read until the
+   * queue is emptied a bit.
+   * @return false when client sent a bad telegram and must be dropped.
+   */
+  bool split(Client* c) {
+    qint64 now = monotonic();
+    int used = 0;
+    while (c->count < CLIENTQUEUE) {
+      if (c->inputSize - used >= 2 &&
+          (c->input[used] | (c->input[used+1] << 8)) > MAXCOMMAND) {
+        return false;
+      }
+      int size = telegramLength(c->input + used, c->inputSize - used);
+      if (size == 0) break;
+      if (size < 4) return false;
+      Frame& f = c->queue[(c->head + c->count) % CLIENTQUEUE];
+      memcpy(f.bytes, c->input + used, size);
+      f.size = size;
+      f.at = now;
+      c->count++;
+      used += size;
+    }
+    memmove(c->input, c->input + used, c->inputSize - used);
+    c->inputSize -= used;
+    rewatch(c);
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief readClient method take bytes sent by client.  End of stream
+   * only closes the side of client, replies are still given.
+   * @return false when client was disconnected and must be dropped.
+   */
+  bool readClient(Client* c) {
+    if (c->inputSize < CLIENTINPUT && !c->closing) {
+      int n = read(c->fd, c->input + c->inputSize,
+                   CLIENTINPUT - c->inputSize);
+      if (n < 0 && errno != EAGAIN && errno != EINTR) return false;
+      if (n == 0) c->closing = true;
+      if (n > 0) c->inputSize += n;
+    }
+    return split(c);
+  }
+
+  bool writeClient(Client* c) {
+    int n = send(c->fd, c->output, c->outputSize, MSG_NOSIGNAL);
+    if (n < 0 && errno != EAGAIN && errno != EINTR) return false;
+    if (n > 0) {
+      memmove(c->output, c->output + n, c->outputSize - n);
+      c->outputSize -= n;
+    }
+    rewatch(c);
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief schedule method move telegrams of clients to the link, one per
+   * client each round, while link has room and the window of replies is
+   * not full.
+   */
+  void schedule() {
+    int idle = 0;
+    while (!order.isEmpty() && idle < order.size() &&
+           linkOutputSize + MAXTELEGRAM <= LINKOUTPUT &&
+           pending.size() < WINDOW) {
+      if (turn >= order.size()) turn = 0;
+      Client* c = order[turn++];
+      if (c->count == 0) {
+        idle++;
+        continue;
+      }
+      idle = 0;
+      Frame& f = c->queue[c->head];
+      memcpy(linkOutput + linkOutputSize, f.bytes, f.size);
+      linkOutputSize += f.size;
+      if (capture) capture->record(Capture::OUTGOING, f.bytes, f.size);
+      if (!(f.bytes[2] & 0x80)) {
+        Pending p = { c->id, f.bytes[3] };
+        pending.enqueue(p);
+        c->waiting++;
+      }
+      qint64 waited = monotonic() - f.at;
+      delay += waited;
+      worst = qMax(worst, waited);
+      relayed++;
+      c->head = (c->head + 1) % CLIENTQUEUE;
+      c->count--;
+      if (!split(c) || done(c)) {
+        drop(c);
+        idle = 0;
+      }
+    }
+    flushLink();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief flushLink method write to RFCOMM socket what it accepts.
+   */
+  bool flushLink() {
+    if (linkOutputSize > 0) {
+      int n = send(link, linkOutput, linkOutputSize, MSG_NOSIGNAL);
+      if (n < 0 && errno != EAGAIN && errno != EINTR) return false;
+      if (n > 0) {
+        memmove(linkOutput, linkOutput + n, linkOutputSize - n);
+        linkOutputSize -= n;
+      }
+    }
+    bool out = linkOutputSize > 0;
+    if (out != linkWriting) {
+      linkWriting = out;
+      watch(link, LINK, true, out, false);
+    }
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief readLink method give each reply to the client waiting for it,
+   * the first pending of same command; pending before it were lost.
+   * Replies nobody waits, and replies of clients already gone, are
+   * discarded.
+   * @return false when the brick was disconnected.
+   */
+  bool readLink() {
+    int n = read(link, linkInput + linkInputSize,
+                 MAXTELEGRAM - linkInputSize);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) return false;
+    if (n < 0) return true;
+    linkInputSize += n;
+
+    for (;;) {
+      if (linkInputSize >= 2 &&
+          (linkInput[0] | (linkInput[1] << 8)) > MAXCOMMAND) {
+        return false;
+      }
+      int size = telegramLength(linkInput, linkInputSize);
+      if (size == 0) break;
+      if (capture) capture->record(Capture::INCOMING, linkInput, size);
+      int lost = 0;
+      while (size >= 4 && lost < pending.size() &&
+             pending[lost].opcode != linkInput[3]) {
+        lost++;
+      }
+      for (int i=0; size >= 4 && lost < pending.size() && i<=lost; i++) {
+        Client* c = clients.value(pending.dequeue().client, NULL);
+        if (!c) continue;
+        c->waiting--;
+        if (i < lost) {
+          if (done(c)) drop(c);
+        }
+        else if (c->outputSize + size > CLIENTOUTPUT) {
+          drop(c);
+        }
+        else {
+          memcpy(c->output + c->outputSize, linkInput, size);
+          c->outputSize += size;
+          if (!writeClient(c) || done(c)) drop(c);
+        }
+      }
+      replies++;
+      memmove(linkInput, linkInput + size, linkInputSize - size);
+      linkInputSize -= size;
+    }
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief report method print throughput and queueing delay added by the
+   * relay each ten seconds.
+   */
+  void report() {
+    qint64 now = monotonic();
+    double seconds = (now - reported) / 1e9;
+    if (seconds < 10) return;
+    printf("relay: %d clients, %.1f telegrams/s, %.1f replies/s, "
+           "queueing %.2f ms mean, %.2f ms worst\n",
+           order.size(), relayed / seconds, replies / seconds,
+           relayed ? delay / 1e6 / relayed : 0.0, worst / 1e6);
+    if (capture && capture->lost() > 0) {
+      printf("relay: %d telegrams lost by capture\n", capture->lost());
+    }
+    fflush(stdout);
+    relayed = replies = delay = worst = 0;
+    reported = now;
+  }
+
+public:
+
+  /** ----------------------------------------------------------------------
+   * @brief Relay constructor, nothing is opened until exec.
+   */
+  Relay() : epoll(-1), link(-1), tcp(-1), local(-1), nextId(FIRSTCLIENT),
+            turn(0), linkOutputSize(0), linkInputSize(0), linkWriting(false),
+            capture(NULL), relayed(0), replies(0), delay(0), worst(0),
+            reported(0) {
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setCapture method record all traffic with brick (see capture.h)
+   */
+  void setCapture(Capture* c) {
+    capture = c;
+  }
+
+  ~Relay() {
+    foreach (Client* c, order) {
+      close(c->fd);
+      delete c;
+    }
+    if (tcp >= 0) close(tcp);
+    if (local >= 0) {
+      close(local);
+      unlink(localPath.toStdString().c_str());
+    }
+    if (link >= 0) close(link);
+    if (epoll >= 0) close(epoll);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief exec method connect with brick at "address" and serve clients
+   * until the brick is disconnected.  An address starting with "/" is the
+   * Unix socket of a brick stand-in.  "path" of Unix socket is optional.
+   * @return exit code of application.
+   */
+  int exec(QString address, int port, QString path) {
+    int s = address.startsWith("/") ? connectUnix(address) :
+                                      Network::rfcomm(address);
+    if (s < 0) {
+      perror("connecting brick");
+      return 1;
+    }
+    return serve(s, port, path);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief serve method is the loop of relay over an open connection with
+   * brick (any stream socket talking Bluetooth framing).
+   * @return exit code of application.
+   */
+  int serve(int brick, int port, QString path) {
+    signal(SIGPIPE, SIG_IGN);
+    link = brick;
+    nonBlocking(link);
+    tcp = listenTcp(port);
+    if (tcp < 0) {
+      perror("opening relay port");
+      return 1;
+    }
+    if (!path.isEmpty()) {
+      localPath = path;
+      local = listenUnix(path);
+      if (local < 0) {
+        perror("opening relay socket");
+        return 1;
+      }
+    }
+
+    epoll = epoll_create1(0);
+    watch(link, LINK, true, false, true);
+    watch(tcp, TCP, true, false, true);
+    if (local >= 0) watch(local, UNIX, true, false, true);
+    reported = monotonic();
+
+    struct epoll_event events[MAXEVENTS];
+    for (;;) {
+      int n = epoll_wait(epoll, events, MAXEVENTS, 1000);
+      if (n < 0 && errno != EINTR) break;
+      for (int i=0; i<n; i++) {
+        quint64 key = events[i].data.u64;
+        if (key == LINK) {
+          if ((events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP)) &&
+              !readLink()) {
+            fprintf(stderr, "relay: brick disconnected\n");
+            return 1;
+          }
+          if ((events[i].events & EPOLLOUT) && !flushLink()) return 1;
+        }
+        else if (key == TCP)  acceptClients(tcp);
+        else if (key == UNIX) acceptClients(local);
+        else {
+          Client* c = clients.value(key, NULL);
+          if (!c) continue;
+          bool alive = !(events[i].events & (EPOLLERR|EPOLLHUP));
+          if (alive && (events[i].events & EPOLLIN)) alive = readClient(c);
+          if (alive && (events[i].events & EPOLLOUT)) alive = writeClient(c);
+          if (!alive || done(c)) drop(c);
+        }
+      }
+      schedule();
+      report();
+    }
+    return 1;
+  }
+};
+
+#endif // RELAY_H
@@ -0,0 +1,295 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** ========================================================================
+ * @brief Layout of the shared memory segment (shm_open) where processes of
+ * the same machine put setpoints of motors and read telemetry back.  Each
+ * part is in its own cache line and is guarded by a seqlock: a writer
+ * makes the sequence odd, writes, and makes it even again; a reader copies
+ * the part and retries when the sequence was odd or changed meanwhile.
+ * Writers take the sequence with compare-and-swap, so several of them can
+ * share a part.
+ *   0    "NXTS" (magic), version and process id of the application
+ *   64   setpoints, written by clients: power of A, B and C (-100..100)
+ *        and the monotonic time (ns) of writing
+ *   128  telemetry, written by application: time of sample and values
+ *        (same channels as telemetry files), and the last setpoints sent
+ *        with their latency from writing until they left to brick
+ *   512  names of channels (SEGMENTNAMEWIDTH bytes each, ended by null)
+ * This file is plain C++ to share it with tools/setpoints.cpp.
+ */
+enum segmentlayout {
+  SEGMENTMAGIC     = 0x5354584E,    // "NXTS"
+  SEGMENTVERSION   = 1,
+  SEGMENTCHANNELS  = 32,
+  SEGMENTNAMEWIDTH = 16,
+  SEGMENTRETRIES   = 1000           // of readers, while a writer is inside
+};
+
+#define SEGMENTNAME "/nxt-pc-remote-control"
+
+struct SegmentLayout {
+  uint32_t magic;
+  uint32_t version;
+  int32_t  pid;           // of the application that created the segment
+  uint8_t  unused0[52];
+
+  uint32_t setSequence;
+  int8_t   power[3];
+  uint8_t  unused1;
+  int64_t  written;
+  uint8_t  unused2[48];
+
+  uint32_t getSequence;
+  uint32_t channels;
+  int64_t  time;
+  uint32_t applied;       // setSequence of the setpoints sent last
+  uint32_t unused3;
+  int64_t  latency;       // ns from writing of those setpoints to the wire
+  int32_t  values[SEGMENTCHANNELS];
+  uint8_t  unused4[224];
+
+  char     names[SEGMENTCHANNELS][SEGMENTNAMEWIDTH];
+};
+
+inline int64_t monotonicNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+/** ========================================================================
+ * @brief SetpointSegment class map the segment, created by the application
+ * and opened by clients, and give the seqlock operations of both sides.
+ */
+class SetpointSegment {
+private:
+  SegmentLayout* shared;
+  bool           owner;
+
+  /** ----------------------------------------------------------------------
+   * @brief lock method make "sequence" odd, waiting other writer.
+   * @return the even value it had
+   */
+  static uint32_t lock(uint32_t* sequence) {
+    uint32_t s = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+    while ((s & 1) ||
+           !__atomic_compare_exchange_n(sequence, &s, s+1, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      if (s & 1) s = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return s;
+  }
+
+  static void unlock(uint32_t* sequence, uint32_t s) {
+    __atomic_store_n(sequence, s+2, __ATOMIC_RELEASE);
+  }
+
+  template <class T>
+  static void put(T* field, T value) {
+    __atomic_store_n(field, value, __ATOMIC_RELAXED);
+  }
+
+  template <class T>
+  static T get(const T* field) {
+    return __atomic_load_n(field, __ATOMIC_RELAXED);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief stable method tell if a copy taken since "s" is whole.
+   */
+  static bool stable(const uint32_t* sequence, uint32_t s) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return !(s & 1) && __atomic_load_n(sequence, __ATOMIC_RELAXED) == s;
+  }
+
+public:
+
+  SetpointSegment() : shared(NULL), owner(false) {
+  }
+
+  ~SetpointSegment() {
+    close();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief holder method tell the application that has the segment, when
+   * it is still running (signal 0 only checks the process exists).
+   * @return its process id, or 0 when there is no segment or it is left by
+   * an application that crashed
+   */
+  static pid_t holder() {
+    int fd = shm_open(SEGMENTNAME, O_RDONLY, 0);
+    if (fd < 0) return 0;
+    struct stat status;
+    void* p = fstat(fd, &status) == 0 &&
+              status.st_size >= (off_t)sizeof(SegmentLayout) ?
+              mmap(NULL, sizeof(SegmentLayout), PROT_READ, MAP_SHARED, fd,
+                   0) : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) return 0;
+    const SegmentLayout* other = (const SegmentLayout*)p;
+    pid_t pid = 0;
+    if (__atomic_load_n(&other->magic, __ATOMIC_ACQUIRE) == SEGMENTMAGIC) {
+      pid = other->pid;
+    }
+    munmap(p, sizeof(SegmentLayout));
+    if (pid <= 0) return 0;
+    return kill(pid, 0) == 0 || errno == EPERM ? pid : 0;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief create method make a new segment, by the application.  A
+   * segment left by an application that crashed is replaced, but not the
+   * one of an application still running (see holder).
+   */
+  bool create(const char* const* names, int channels) {
+    if (channels > SEGMENTCHANNELS) return false;
+    int fd = shm_open(SEGMENTNAME, O_RDWR|O_CREAT|O_EXCL, 0660);
+    if (fd < 0 && errno == EEXIST && holder() == 0) {
+      shm_unlink(SEGMENTNAME);
+      fd = shm_open(SEGMENTNAME, O_RDWR|O_CREAT|O_EXCL, 0660);
+    }
+    if (fd < 0) return false;
+    bool ok = ftruncate(fd, sizeof(SegmentLayout)) == 0;
+    void* p = ok ? mmap(NULL, sizeof(SegmentLayout), PROT_READ|PROT_WRITE,
+                        MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      shm_unlink(SEGMENTNAME);
+      return false;
+    }
+    shared = (SegmentLayout*)p;
+    owner = true;
+    for (int i=0; i<channels; i++) {
+      strncpy(shared->names[i], names[i], SEGMENTNAMEWIDTH-1);
+    }
+    shared->channels = channels;
+    shared->version = SEGMENTVERSION;
+    shared->pid = getpid();
+    __atomic_store_n(&shared->magic, (uint32_t)SEGMENTMAGIC,
+                     __ATOMIC_RELEASE);
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief open method map the segment of a running application.
+   */
+  bool open() {
+    int fd = shm_open(SEGMENTNAME, O_RDWR, 0);
+    if (fd < 0) return false;
+    void* p = mmap(NULL, sizeof(SegmentLayout), PROT_READ|PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    shared = (SegmentLayout*)p;
+    owner = false;
+    if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != SEGMENTMAGIC ||
+        shared->version != SEGMENTVERSION) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief close method unmap the segment, the application also removes
+   * its name (clients already mapped keep it until they close).
+   */
+  void close() {
+    if (!shared) return;
+    munmap(shared, sizeof(SegmentLayout));
+    if (owner) shm_unlink(SEGMENTNAME);
+    shared = NULL;
+  }
+
+  bool isOpen() const { return shared != NULL; }
+
+  /** ----------------------------------------------------------------------
+   * @brief writeSetpoints method put power of A, B and C, by clients.
+   * @return sequence of the new setpoints
+   */
+  uint32_t writeSetpoints(const int8_t power[3]) {
+    uint32_t s = lock(&shared->setSequence);
+    for (int i=0; i<3; i++) put(&shared->power[i], power[i]);
+    put(&shared->written, monotonicNow());
+    unlock(&shared->setSequence, s);
+    return s+2;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief readSetpoints method copy the last setpoints, by application.
+   * @return false when a writer did not finish after SEGMENTRETRIES tries
+   */
+  bool readSetpoints(int8_t power[3], int64_t& written, uint32_t& sequence) {
+    for (int tries=0; tries<SEGMENTRETRIES; tries++) {
+      uint32_t s = __atomic_load_n(&shared->setSequence, __ATOMIC_ACQUIRE);
+      for (int i=0; i<3; i++) power[i] = get(&shared->power[i]);
+      written = get(&shared->written);
+      if (stable(&shared->setSequence, s)) {
+        sequence = s;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief publish method put a sample of telemetry, by application.
+   */
+  void publish(int64_t time, const int32_t* values, int count) {
+    uint32_t s = lock(&shared->getSequence);
+    put(&shared->time, time);
+    for (int i=0; i<count && i<SEGMENTCHANNELS; i++) {
+      put(&shared->values[i], values[i]);
+    }
+    unlock(&shared->getSequence, s);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief applied method tell which setpoints were sent last and their
+   * latency, by application.
+   */
+  void applied(uint32_t sequence, int64_t latency) {
+    uint32_t s = lock(&shared->getSequence);
+    put(&shared->applied, sequence);
+    put(&shared->latency, latency);
+    unlock(&shared->getSequence, s);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief readTelemetry method copy the last sample and the last setpoints
+   * sent, by clients.  "values" has room for SEGMENTCHANNELS.
+   */
+  bool readTelemetry(int64_t& time, int32_t* values, uint32_t& sequence,
+                     int64_t& latency) {
+    for (int tries=0; tries<SEGMENTRETRIES; tries++) {
+      uint32_t s = __atomic_load_n(&shared->getSequence, __ATOMIC_ACQUIRE);
+      time = get(&shared->time);
+      for (int i=0; i<SEGMENTCHANNELS; i++) {
+        values[i] = get(&shared->values[i]);
+      }
+      sequence = get(&shared->applied);
+      latency = get(&shared->latency);
+      if (stable(&shared->getSequence, s)) return true;
+    }
+    return false;
+  }
+
+  int channels() const { return shared->channels; }
+
+  const char* name(int c) const { return shared->names[c]; }
+};
+
+#endif // SEGMENT_H
@@ -0,0 +1,282 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QQueue>
+#include <QFrame>
+#include <QFormLayout>
+#include <QCheckBox>
+#include <QLabel>
+#include <QTimer>
+
+#include <segment.h>
+#include <motors.h>
+#include <recorder.h>
+#include <idiom.h>
+
+/** ========================================================================
+ * @brief SharedControl class let other processes of the machine drive the
+ * motors through a shared memory segment (see segment.h), without sockets
+ * nor copies through the GUI.  At each tick of RATE the last setpoints are
+ * read and, when a client wrote new ones, given to Motors, which sends only
+ * the ports that changed.  Recorder publishes its samples in the same
+ * segment.  The segment exists while it is enabled; the thread runs while
+ * the brick is also connected.  Latency of setpoints is measured until
+ * their telegrams are written to brick, told by Network.
+ */
+class SharedControl : public QThread, public WriteHandler {
+public:
+  enum { RATE = 200 };
+
+private:
+  struct Unsent {
+    uint32_t sequence;
+    qint64   written;    // by client
+    int      telegrams;  // not written to brick yet
+  };
+
+  Network*        net;
+  Motors*         motors;
+  Recorder*       recorder;
+  SetpointSegment segment;
+  QMutex          lock;
+  QAtomicInt      running;
+  bool            enabled;
+  bool            attached;
+  QQueue<Unsent>  unsent;
+  // statistics of current second
+  int             count;
+  qint64          sum;
+  qint64          worst;
+  // statistics of last second
+  double          updates;
+  qint64          latencyMean;
+  qint64          latencyMax;
+
+  /** ----------------------------------------------------------------------
+   * @brief measured method publish the latency of setpoints and count it.
+   * Lock must be taken.
+   */
+  void measured(const Unsent& u, qint64 at) {
+    qint64 latency = at - u.written;
+    segment.applied(u.sequence, latency);
+    sum += latency;
+    worst = qMax(worst, latency);
+    count++;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief engage method start or stop the thread, as Controller does.
+   */
+  void engage() {
+    bool wanted = enabled && attached && segment.isOpen();
+    if (wanted && !isRunning()) {
+      updates = 0;
+      latencyMean = latencyMax = 0;
+      unsent.clear();
+      count = 0;
+      sum = worst = 0;
+      running.store(1);
+      start();
+    }
+    else if (!wanted && isRunning()) {
+      running.store(0);
+      wait();
+      net->forgetWrites(this);
+    }
+  }
+
+protected:
+
+  /** ----------------------------------------------------------------------
+   * @brief run method tick at RATE with absolute deadlines.  Setpoints
+   * written before the start are old and are not applied.  Latency is
+   * counted from the write of a client until the last of its telegrams is
+   * written to brick ("written" method), or until Motors returned when no
+   * telegram was sent (controller active or same powers).
+   */
+  void run() {
+    qint64 period = 1000000000LL / RATE;
+    qint64 deadline = monotonic();
+    qint64 second = deadline;
+    int8_t power[3];
+    int64_t written;
+    uint32_t last = 0, sequence;
+    segment.readSetpoints(power, written, last);
+
+    while (running.load()) {
+      deadline += period;
+      struct timespec wake;
+      wake.tv_sec  = deadline / 1000000000LL;
+      wake.tv_nsec = deadline % 1000000000LL;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+
+      if (segment.readSetpoints(power, written, sequence) &&
+          sequence != last) {
+        signed char wanted[3];
+        for (int i=0; i<3; i++) wanted[i] = qBound(-100, (int)power[i], 100);
+        QMutexLocker locker(&lock);
+        Unsent u = { sequence, written, motors->apply(wanted, this) };
+        if (u.telegrams > 0) unsent.enqueue(u);
+        else                 measured(u, monotonic());
+        last = sequence;
+      }
+
+      qint64 now = monotonic();
+      if (now - second >= 1000000000LL) {
+        QMutexLocker locker(&lock);
+        updates = count * 1e9 / (now - second);
+        latencyMean = count > 0 ? sum / count : 0;
+        latencyMax = worst;
+        sum = worst = 0;
+        count = 0;
+        second = now;
+      }
+      if (now - deadline > period) deadline = now;
+    }
+    motors->stop();
+  }
+
+public:
+
+  SharedControl(Network* n, Motors* m, Recorder* r)
+    : net(n), motors(m), recorder(r), running(0), enabled(false),
+      attached(false), count(0), sum(0), worst(0), updates(0),
+      latencyMean(0), latencyMax(0) {
+  }
+
+  ~SharedControl() {
+    setEnabled(false);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setEnabled method create or remove the segment.
+   * @return false when the segment could not be created
+   */
+  bool setEnabled(bool on) {
+    if (on && !segment.isOpen()) {
+      enabled = segment.create(Recorder::names(), Recorder::CHANNELS);
+      if (enabled) recorder->setSegment(&segment);
+    }
+    else if (!on && segment.isOpen()) {
+      enabled = false;
+      engage();
+      recorder->setSegment(NULL);
+      segment.close();
+    }
+    engage();
+    return enabled == on;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief setAttached method tell if brick is connected, it must be called
+   * before Network::unbind.
+   */
+  void setAttached(bool on) {
+    attached = on;
+    engage();
+  }
+
+  bool active() { return isRunning(); }
+
+  /** ----------------------------------------------------------------------
+   * @brief written method, from sender thread of Network, count a telegram
+   * of the oldest setpoints not written yet; with the last one their
+   * latency is known.
+   */
+  void written(qint64 at) {
+    QMutexLocker locker(&lock);
+    if (unsent.isEmpty()) return;
+    if (--unsent.head().telegrams == 0) measured(unsent.dequeue(), at);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief frequency and latency methods return setpoints applied per
+   * second and their latency (ns) in the last second.
+   */
+  double frequency() {
+    QMutexLocker locker(&lock);
+    return updates;
+  }
+
+  void latency(qint64& mean, qint64& maximum) {
+    QMutexLocker locker(&lock);
+    mean = latencyMean;
+    maximum = latencyMax;
+  }
+};
+
+/** ========================================================================
+ * @brief SharedPanel class is the window to enable SharedControl and see
+ * its rate and latency.
+ */
+class SharedPanel : public QFrame {
+  Q_OBJECT
+private:
+  SharedControl* shared;
+  Idiom*         idiom;
+  QCheckBox*     enabled;
+  QLabel         *segment,*stats;
+  QTimer*        timer;
+
+public:
+
+  SharedPanel(SharedControl* s, Idiom* i) : shared(s), idiom(i) {
+    enabled = new QCheckBox();
+    segment = new QLabel(QString("/dev/shm") + SEGMENTNAME);
+    stats   = new QLabel();
+    timer   = new QTimer(this);
+
+    QFormLayout* layout = new QFormLayout();
+    setLayout(layout);
+    layout->addRow(enabled);
+    layout->addRow(segment);
+    layout->addRow(stats);
+    setStyleSheet("QFrame{background-color:white}");
+    refreshIdiom();
+
+    connect(enabled,SIGNAL(toggled(bool)),this,SLOT(toggle(bool)));
+    connect(timer,SIGNAL(timeout()),this,SLOT(refreshStats()));
+    timer->start(500);
+  }
+
+  void refreshIdiom() {
+    setWindowTitle(idiom->text(TXT_MENUSHARED));
+    enabled->setText(idiom->text(TXT_SHAREDENABLED));
+    refreshStats();
+  }
+
+public slots:
+
+  void toggle(bool on) {
+    if (!shared->setEnabled(on)) {
+      enabled->setChecked(false);
+      pid_t other = SetpointSegment::holder();
+      stats->setText(other ? idiom->text(TXT_SHAREDBUSY).arg(other)
+                           : idiom->text(TXT_SHAREDERROR));
+      return;
+    }
+    refreshStats();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief refreshStats method show setpoints per second and latency from
+   * the write of a client to the wire.
+   */
+  void refreshStats() {
+    if (!shared->active()) {
+      if (enabled->isChecked()) stats->setText("");
+      return;
+    }
+    qint64 mean, maximum;
+    shared->latency(mean, maximum);
+    stats->setText(idiom->text(TXT_SHAREDSTATS)
+                   .arg(shared->frequency(), 0, 'f', 1)
+                   .arg(mean / 1000).arg(maximum / 1000));
+  }
+};
+
+#endif // SHARED_H
@@ -0,0 +1,102 @@
+#ifndef STEERING_H
+#define STEERING_H
+
+#include <QtGlobal>
+#include <QKeyEvent>
+
+#include <protocol.h>
+
+/** ========================================================================
+ * @brief Steering class keep the keys held by user and mix them as an
+ * arcade drive: Up and Down move both wheels (B left, C right), Left and
+ * Right turn, in place when robot is stopped or softly while moving.
+ * N and M still move motor A.  Powers are negative to go forward, as robot
+ * is built.
+ */
+class Steering {
+public:
+  enum key {
+    FORWARD  = 0x01,
+    BACKWARD = 0x02,
+    LEFT     = 0x04,
+    RIGHT    = 0x08,
+    RAISE    = 0x10,
+    LOWER    = 0x20
+  };
+
+private:
+  int held;
+
+  /** ----------------------------------------------------------------------
+   * @brief bit method return the key of steering for a Qt key code, zero
+   * for other keys.
+   */
+  static int bit(int code) {
+    switch (code) {
+      case Qt::Key_Up:    return FORWARD;
+      case Qt::Key_Down:  return BACKWARD;
+      case Qt::Key_Left:  return LEFT;
+      case Qt::Key_Right: return RIGHT;
+      case Qt::Key_N:     return RAISE;
+      case Qt::Key_M:     return LOWER;
+    }
+    return 0;
+  }
+
+  int axis(int positive, int negative) const {
+    return ((held & positive) ? 1 : 0) - ((held & negative) ? 1 : 0);
+  }
+
+public:
+
+  Steering() : held(0) {
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief press method take a key pressed, other keys are ignored.
+   */
+  void press(int code) {
+    held |= bit(code);
+  }
+
+  void release(int code) {
+    held &= ~bit(code);
+  }
+
+  void clear() {
+    held = 0;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief arcade method compute power of ports A, B and C from a move
+   * (forward positive), a turn (right positive) and a move of motor A, all
+   * of them between -1 and 1.  Wheels never exceed "level".
+   */
+  static void arcade(double move, double turn, double arm, int level,
+                     signed char out[3]) {
+    double left  = move + turn;
+    double right = move - turn;
+    double top = qMax(qAbs(left), qAbs(right));
+    if (top > 1) {
+      left  /= top;
+      right /= top;
+    }
+    out[PORT_A] = (signed char) qRound(arm * level);
+    out[PORT_B] = (signed char) -qRound(left * level);
+    out[PORT_C] = (signed char) -qRound(right * level);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief mix method compute power of ports A, B and C for keys held.
+   * Opposite keys cancel.  While moving, the inner wheel turns at a third
+   * of the outer one.
+   */
+  void mix(int level, signed char out[3]) const {
+    int move = axis(FORWARD, BACKWARD);
+    int turn = axis(RIGHT, LEFT);
+    arcade(move, move == 0 ? turn : turn*0.5, axis(RAISE, LOWER), level,
+           out);
+  }
+};
+
+#endif // STEERING_H
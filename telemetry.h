@@ -0,0 +1,349 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** ========================================================================
+ * @brief Layout of telemetry files.  A header page is followed by chunks of
+ * CHUNKSAMPLES samples; inside a chunk, each channel is a column:
+ *   timestamps (8 bytes, ns since start) of all samples of the chunk,
+ *   then values (4 bytes) of channel 0, of channel 1, and so on.
+ * Header page:
+ *   0   "NXTT", version (2 bytes), count of channels (2 bytes)
+ *   8   samples per chunk (4 bytes), unused (4 bytes)
+ *   16  start of recording (8 bytes, ns of realtime clock)
+ *   64  two progress slots (sequence, samples, check; 8 bytes each)
+ *   128 names of channels (NAMEWIDTH bytes each, ended by null)
+ * Progress is written alternating slots, so one of them is always whole;
+ * readers take the valid one with greater sequence.  Only samples counted
+ * there are trusted.  All numbers are little endian (as the PC).
+ * This file is plain C++ to share it with tools/telemetry.cpp.
+ */
+enum telemetrylayout {
+  HEADERSIZE   = 4096,
+  CHUNKSAMPLES = 4096,
+  NAMEWIDTH    = 16,
+  PROGRESSAT   = 64,
+  NAMESAT      = 128,
+  MAXCHANNELS  = (HEADERSIZE - NAMESAT) / NAMEWIDTH,
+  GROWCHUNKS   = 16     // chunks allocated ahead while recording
+};
+
+struct TelemetryProgress {
+  uint64_t sequence;
+  uint64_t samples;
+  uint64_t check;
+
+  /** ----------------------------------------------------------------------
+   * @brief hash method is FNV-1a of sequence and samples.
+   */
+  uint64_t hash() const {
+    uint64_t h = 14695981039346656037ULL;
+    const unsigned char* bytes = (const unsigned char*)this;
+    for (int i=0; i<16; i++) {
+      h ^= bytes[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+};
+
+inline int64_t chunkBytes(int channels) {
+  return (int64_t)CHUNKSAMPLES * (8 + 4*channels);
+}
+
+inline int64_t chunkOffset(int channels, int64_t chunk) {
+  return HEADERSIZE + chunk * chunkBytes(channels);
+}
+
+/** ========================================================================
+ * @brief TelemetryWriter class append samples (a timestamp and a value of
+ * each channel) to a telemetry file.  Only the header and the chunk in use
+ * are mapped, so memory does not grow with the length of recording; the
+ * file grows GROWCHUNKS chunks at a time.
+ */
+class TelemetryWriter {
+private:
+  int            fd;
+  int            count;       // channels
+  unsigned char* header;
+  unsigned char* chunk;
+  int64_t        mappedChunk;
+  int64_t        allocated;   // bytes of file
+  uint64_t       samples;
+  uint64_t       sequence;
+
+  /** ----------------------------------------------------------------------
+   * @brief map method map chunk "k", growing the file when needed.
+   */
+  bool map(int64_t k) {
+    if (chunk) munmap(chunk, chunkBytes(count));
+    chunk = NULL;
+    int64_t end = chunkOffset(count, k+1);
+    if (end > allocated) {
+      int64_t size = chunkOffset(count, k+GROWCHUNKS);
+      if (posix_fallocate(fd, 0, size) != 0 && ftruncate(fd, size) != 0) {
+        return false;
+      }
+      allocated = size;
+    }
+    void* p = mmap(NULL, chunkBytes(count), PROT_READ|PROT_WRITE,
+                   MAP_SHARED, fd, chunkOffset(count, k));
+    if (p == MAP_FAILED) return false;
+    chunk = (unsigned char*)p;
+    mappedChunk = k;
+    return true;
+  }
+
+public:
+
+  TelemetryWriter() : fd(-1), count(0), header(NULL), chunk(NULL),
+                      mappedChunk(-1), allocated(0), samples(0),
+                      sequence(0) {
+  }
+
+  ~TelemetryWriter() {
+    close();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief create method start a new file with "channels" named columns.
+   * @param start realtime of first sample (ns)
+   */
+  bool create(const char* path, const char* const* names, int channels,
+              int64_t start) {
+    if (channels < 1 || channels > MAXCHANNELS) return false;
+    fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0) return false;
+    count = channels;
+    samples = 0;
+    sequence = 0;
+    allocated = HEADERSIZE;
+    if (ftruncate(fd, HEADERSIZE) != 0) {
+      close();
+      return false;
+    }
+    void* p = mmap(NULL, HEADERSIZE, PROT_READ|PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (p == MAP_FAILED) {
+      header = NULL;
+      close();
+      return false;
+    }
+    header = (unsigned char*)p;
+    memcpy(header, "NXTT", 4);
+    uint16_t version = 1, width = channels;
+    uint32_t perChunk = CHUNKSAMPLES;
+    memcpy(header+4, &version, 2);
+    memcpy(header+6, &width, 2);
+    memcpy(header+8, &perChunk, 4);
+    memcpy(header+16, &start, 8);
+    for (int i=0; i<channels; i++) {
+      strncpy((char*)header + NAMESAT + i*NAMEWIDTH, names[i], NAMEWIDTH-1);
+    }
+    commit();
+    msync(header, HEADERSIZE, MS_SYNC);
+    return map(0);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief append method add a sample, "values" has one per channel.
+   */
+  bool append(int64_t time, const int32_t* values) {
+    if (!header) return false;
+    int64_t k = samples / CHUNKSAMPLES;
+    int i = samples % CHUNKSAMPLES;
+    if (k != mappedChunk) {
+      commit();
+      if (!map(k)) return false;
+    }
+    memcpy(chunk + 8*i, &time, 8);
+    for (int c=0; c<count; c++) {
+      memcpy(chunk + 8*CHUNKSAMPLES + 4*((int64_t)c*CHUNKSAMPLES + i),
+             &values[c], 4);
+    }
+    samples++;
+    return true;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief commit method put samples appended in the file and then count
+   * them in header.  Samples after the last commit are lost on a crash.
+   */
+  void commit() {
+    if (!header) return;
+    if (chunk) msync(chunk, chunkBytes(count), MS_SYNC);
+    TelemetryProgress progress;
+    progress.sequence = ++sequence;
+    progress.samples  = samples;
+    progress.check    = progress.hash();
+    memcpy(header + PROGRESSAT + (sequence % 2)*sizeof(progress),
+           &progress, sizeof(progress));
+    msync(header, HEADERSIZE, MS_ASYNC);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief close method commit and cut the chunks allocated ahead.
+   */
+  bool close() {
+    bool done = true;
+    if (header) {
+      commit();
+      int64_t used = (samples + CHUNKSAMPLES - 1) / CHUNKSAMPLES;
+      done = ftruncate(fd, chunkOffset(count, used)) == 0;
+    }
+    if (chunk) munmap(chunk, chunkBytes(count));
+    if (header) munmap(header, HEADERSIZE);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    header = NULL;
+    chunk = NULL;
+    mappedChunk = -1;
+    return done;
+  }
+
+  bool     isOpen() const { return header != NULL; }
+  uint64_t size()   const { return samples; }
+};
+
+/** ========================================================================
+ * @brief TelemetryReader class read a telemetry file one chunk at a time,
+ * columns are given as arrays to scan them quickly.
+ */
+class TelemetryReader {
+private:
+  int                  fd;
+  int                  count;
+  const unsigned char* header;
+  const unsigned char* chunk;
+  int64_t              mappedChunk;
+  uint64_t             samples;
+  int64_t              begin;
+
+public:
+
+  TelemetryReader() : fd(-1), count(0), header(NULL), chunk(NULL),
+                      mappedChunk(-1), samples(0), begin(0) {
+  }
+
+  ~TelemetryReader() {
+    close();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief open method check the header and take the committed samples.
+   */
+  bool open(const char* path) {
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < HEADERSIZE) {
+      close();
+      return false;
+    }
+    void* p = mmap(NULL, HEADERSIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      close();
+      return false;
+    }
+    header = (const unsigned char*)p;
+    uint16_t version, width;
+    uint32_t perChunk;
+    memcpy(&version, header+4, 2);
+    memcpy(&width, header+6, 2);
+    memcpy(&perChunk, header+8, 4);
+    memcpy(&begin, header+16, 8);
+    if (memcmp(header, "NXTT", 4) != 0 || version != 1 || width < 1 ||
+        width > MAXCHANNELS || perChunk != CHUNKSAMPLES) {
+      close();
+      return false;
+    }
+    count = width;
+    for (int i=0; i<count; i++) {
+      if (header[NAMESAT + i*NAMEWIDTH + NAMEWIDTH-1] != 0) {
+        close();
+        return false;
+      }
+    }
+    uint64_t best = 0;
+    for (int i=0; i<2; i++) {
+      TelemetryProgress progress;
+      memcpy(&progress, header + PROGRESSAT + i*sizeof(progress),
+             sizeof(progress));
+      if (progress.check == progress.hash() && progress.sequence > best) {
+        best = progress.sequence;
+        samples = progress.samples;
+      }
+    }
+    int64_t whole = (info.st_size - HEADERSIZE) / chunkBytes(count);
+    if (samples > (uint64_t)whole * CHUNKSAMPLES) {
+      samples = whole * CHUNKSAMPLES;
+    }
+    return true;
+  }
+
+  void close() {
+    if (chunk) munmap((void*)chunk, chunkBytes(count));
+    if (header) munmap((void*)header, HEADERSIZE);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    header = NULL;
+    chunk = NULL;
+    mappedChunk = -1;
+  }
+
+  int      channels() const { return count; }
+  uint64_t size()     const { return samples; }
+  int64_t  start()    const { return begin; }
+  int64_t  chunks()   const {
+    return (samples + CHUNKSAMPLES - 1) / CHUNKSAMPLES;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief name method return the name of a channel (null ended, it was
+   * checked at open).
+   */
+  const char* name(int channel) const {
+    return (const char*)header + NAMESAT + channel*NAMEWIDTH;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief load method map chunk "k", the previous one is released.
+   * @return count of samples in chunk, 0 when it can not be read.
+   */
+  int load(int64_t k) {
+    if (k < 0 || k >= chunks()) return 0;
+    if (k != mappedChunk) {
+      if (chunk) munmap((void*)chunk, chunkBytes(count));
+      chunk = NULL;
+      mappedChunk = -1;
+      void* p = mmap(NULL, chunkBytes(count), PROT_READ, MAP_SHARED, fd,
+                     chunkOffset(count, k));
+      if (p == MAP_FAILED) return 0;
+      madvise(p, chunkBytes(count), MADV_SEQUENTIAL);
+      chunk = (const unsigned char*)p;
+      mappedChunk = k;
+    }
+    uint64_t rest = samples - (uint64_t)k*CHUNKSAMPLES;
+    return rest < CHUNKSAMPLES ? (int)rest : CHUNKSAMPLES;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief times and column methods give the arrays of the chunk loaded.
+   */
+  const int64_t* times() const {
+    return (const int64_t*)chunk;
+  }
+
+  const int32_t* column(int channel) const {
+    return (const int32_t*)(chunk + 8*CHUNKSAMPLES +
+                            4*(int64_t)channel*CHUNKSAMPLES);
+  }
+};
+
+#endif // TELEMETRY_H
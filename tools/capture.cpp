@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include <capture.h>
+
+/** ========================================================================
+ * @brief capture tool load the capture ring (capture.h) as the senders and
+ * the receiver of Network do, and report drops and writer throughput.
+ *   capture FILE [RATE [SECONDS [THREADS]]]
+ *       THREADS (2 by default) record RATE telegrams per second in total
+ *       (2000 by default) during SECONDS (5 by default), half outgoing
+ *       SETOUTPUTSTATE and half incoming GETOUTPUTSTATE replies; RATE 0
+ *       records as fast as possible, to see when the ring overflows.
+ * Reported: telegrams recorded and dropped, cost of each record call,
+ * packets in FILE and packets written per second by the capture thread.
+ *
+ * To build it (Qt core is needed by QThread):
+ *   g++ -O2 -fPIC -I.. `pkg-config --cflags Qt5Core` -o capture
+ *       capture.cpp `pkg-config --libs Qt5Core` -lpthread
+ */
+
+static int64_t now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec*1000000000LL + t.tv_nsec;
+}
+
+static void sleepUntil(int64_t deadline) {
+  struct timespec wake;
+  wake.tv_sec  = deadline / 1000000000LL;
+  wake.tv_nsec = deadline % 1000000000LL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+}
+
+/** ------------------------------------------------------------------------
+ * @brief Producer class record telegrams at a constant rate with absolute
+ * deadlines, keeping the time of each record call.
+ */
+class Producer : public QThread {
+public:
+  Capture*             capture;
+  int                  rate;          // per second, 0 as fast as possible
+  int64_t              end;
+  long                 recorded;
+  std::vector<int64_t> costs;
+
+protected:
+  void run() {
+    byte out[MAXTELEGRAM], in[MAXTELEGRAM];
+    int outSize = encode(SetOutputState(PORT_A, 75), out, MAXTELEGRAM);
+    int inSize = 27;                  // GETOUTPUTSTATE reply, 25 bytes
+    memset(in, 0, sizeof(in));
+    in[0] = inSize - 2;
+    in[2] = REPLY;
+    in[3] = OP_GETOUTPUTSTATE;
+    int64_t period = rate > 0 ? 1000000000LL / rate : 0;
+    int64_t deadline = now();
+    while (deadline < end) {
+      if (period) {
+        deadline += period;
+        sleepUntil(deadline);
+      }
+      else {
+        deadline = now();
+      }
+      int64_t before = now();
+      if (recorded & 1) capture->record(Capture::INCOMING, in, inSize);
+      else              capture->record(Capture::OUTGOING, out, outSize);
+      int64_t after = now();
+      if (costs.size() < 1000000) costs.push_back(after - before);
+      recorded++;
+    }
+  }
+};
+
+/** ------------------------------------------------------------------------
+ * @brief packets function count Enhanced Packet Blocks of a pcapng file.
+ */
+static long packets(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return -1;
+  long count = 0;
+  quint32 head[2];
+  while (fread(head, 4, 2, f) == 2 && head[1] >= 12) {
+    if (head[0] == 0x00000006) count++;
+    fseek(f, head[1] - 8, SEEK_CUR);
+  }
+  fclose(f);
+  return count;
+}
+
+int main(int argCount, char* argValues[]) {
+  if (argCount < 2) {
+    fprintf(stderr, "usage: capture FILE [RATE [SECONDS [THREADS]]]\n");
+    return 1;
+  }
+  const char* path = argValues[1];
+  int rate    = argCount > 2 ? atoi(argValues[2]) : 2000;
+  int seconds = argCount > 3 ? std::max(1, atoi(argValues[3])) : 5;
+  int threads = argCount > 4 ? std::max(1, atoi(argValues[4])) : 2;
+
+  Capture capture;
+  if (!capture.open(path)) {
+    perror(path);
+    return 1;
+  }
+  int64_t start = now();
+  std::vector<Producer*> producers;
+  for (int i=0; i<threads; i++) {
+    Producer* p = new Producer();
+    p->capture = &capture;
+    p->rate = rate > 0 ? std::max(1, rate / threads) : 0;
+    p->end = start + seconds*1000000000LL;
+    p->recorded = 0;
+    producers.push_back(p);
+    p->start();
+  }
+  long recorded = 0;
+  std::vector<int64_t> costs;
+  for (size_t i=0; i<producers.size(); i++) {
+    producers[i]->wait();
+    recorded += producers[i]->recorded;
+    costs.insert(costs.end(), producers[i]->costs.begin(),
+                 producers[i]->costs.end());
+    delete producers[i];
+  }
+  int64_t offered = now();
+  capture.stop();                     // drains the ring before closing
+  int64_t closed = now();
+  long dropped = capture.lost();
+  long written = packets(path);
+
+  double elapsed = (offered - start) / 1e9;
+  printf("%d threads, %ld telegrams in %.1f s, %.0f per second\n", threads,
+         recorded, elapsed, recorded / elapsed);
+  printf("dropped %ld (%.2f%%), ring of %d slots\n", dropped,
+         recorded ? 100.0 * dropped / recorded : 0.0, (int)Capture::SLOTS);
+  printf("file %ld packets, %s\n", written,
+         written == recorded - dropped ? "all kept ones" : "MISSING ONES");
+  printf("writer %.0f packets/s, %.1f ms to drain at stop\n",
+         written / ((closed - start) / 1e9), (closed - offered) / 1e6);
+  if (!costs.empty()) {
+    std::sort(costs.begin(), costs.end());
+    int n = costs.size();
+    printf("record call (ns): median %lld  p99 %lld  max %lld\n",
+           (long long)costs[n/2], (long long)costs[(n-1)*99/100],
+           (long long)costs[n-1]);
+  }
+  return written == recorded - dropped ? 0 : 1;
+}
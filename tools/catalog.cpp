@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/** ========================================================================
+ * @brief catalog tool build the binary catalog of a language from its text
+ * source (lines "KEY = text", "#" for comments).  The catalog is:
+ *   "NXTL", version (2 bytes), count of strings (2 bytes),
+ *   offset of each string (4 bytes each), strings in UTF-8 ended by null.
+ * All numbers are little endian.  Strings follow the order of idiomkeys.h.
+ *
+ * To build it: g++ -I.. -o catalog catalog.cpp
+ */
+
+static const char* keys[] = {
+#define IDIOMKEY(name) #name,
+#include <idiomkeys.h>
+#undef IDIOMKEY
+};
+
+static const int count = sizeof(keys)/sizeof(keys[0]);
+
+static std::string trim(const std::string& text) {
+  size_t first = text.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) return "";
+  size_t last = text.find_last_not_of(" \t\r\n");
+  return text.substr(first, last-first+1);
+}
+
+static void put(std::string& out, unsigned value, int bytes) {
+  for (int i=0; i<bytes; i++) out += (char)((value >> (8*i)) & 0xFF);
+}
+
+int main(int argCount, char* argValues[]) {
+  if (argCount != 3) {
+    fprintf(stderr, "usage: catalog source.txt catalog.cat\n");
+    return 1;
+  }
+  FILE* in = fopen(argValues[1], "r");
+  if (!in) {
+    perror(argValues[1]);
+    return 1;
+  }
+
+  std::vector<std::string> texts(count);
+  std::vector<bool> found(count, false);
+  char line[1024];
+  int number = 0;
+  while (fgets(line, sizeof(line), in)) {
+    number++;
+    std::string text = trim(line);
+    if (text.empty() || text[0] == '#') continue;
+    size_t equal = text.find('=');
+    std::string key = trim(text.substr(0, equal));
+    int i = 0;
+    while (i < count && key != keys[i]) i++;
+    if (equal == std::string::npos || i == count) {
+      fprintf(stderr, "%s:%d: unknown key\n", argValues[1], number);
+      return 1;
+    }
+    texts[i] = trim(text.substr(equal+1));
+    found[i] = true;
+  }
+  fclose(in);
+
+  std::string out = "NXTL";
+  put(out, 1, 2);
+  put(out, count, 2);
+  unsigned offset = 8 + 4*count;
+  for (int i=0; i<count; i++) {
+    if (!found[i]) fprintf(stderr, "%s: missing %s\n", argValues[1], keys[i]);
+    put(out, offset, 4);
+    offset += texts[i].size() + 1;
+  }
+  for (int i=0; i<count; i++) out.append(texts[i].c_str(), texts[i].size()+1);
+
+  FILE* file = fopen(argValues[2], "wb");
+  if (!file || fwrite(out.data(), 1, out.size(), file) != out.size()) {
+    perror(argValues[2]);
+    return 1;
+  }
+  fclose(file);
+  return 0;
+}
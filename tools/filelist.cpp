@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <protocol.h>
+
+/** ========================================================================
+ * @brief filelist tool time the listing of brick files as Files does it
+ * (files.h): FIND FIRST, then FIND NEXT requests sent back-to-back with
+ * WINDOW of them in flight, against a brick stand-in of the same process.
+ *   filelist [FILES [LATENCY [SERVICE [WINDOW]]]]
+ *       stand-in with FILES files (30 by default), answering LATENCY ms
+ *       (30) after each request and SERVICE ms (2) after previous reply,
+ *       as the brick serves one request at a time; WINDOW is 8 by default
+ * The list is made with a window of 1 (a request after each reply) and
+ * with WINDOW, and both times are printed.
+ *
+ * To build it: g++ -O2 -I.. -o filelist filelist.cpp -lpthread
+ */
+
+static int64_t now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec*1000000000LL + t.tv_nsec;
+}
+
+static void sleepUntil(int64_t deadline) {
+  struct timespec wake;
+  wake.tv_sec  = deadline / 1000000000LL;
+  wake.tv_nsec = deadline % 1000000000LL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+}
+
+static bool readAll(int fd, byte* bytes, int count) {
+  while (count > 0) {
+    int n = read(fd, bytes, count);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    bytes += n;
+    count -= n;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const byte* bytes, int count) {
+  while (count > 0) {
+    int n = write(fd, bytes, count);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    bytes += n;
+    count -= n;
+  }
+  return true;
+}
+
+/** ------------------------------------------------------------------------
+ * @brief readTelegram function read one telegram, length bytes included.
+ * @return its size, zero when the socket is closed
+ */
+static int readTelegram(int fd, byte* bytes) {
+  if (!readAll(fd, bytes, 2)) return 0;
+  int size = bytes[0] | (bytes[1] << 8);
+  if (size > MAXTELEGRAM - 2 || !readAll(fd, bytes + 2, size)) return 0;
+  return size + 2;
+}
+
+/** ------------------------------------------------------------------------
+ * @brief Brick class answer FIND FIRST and FIND NEXT requests in order,
+ * each one LATENCY after its arrival and SERVICE after previous answer.
+ * Requests after the last file get STATUS_FILENOTFOUND, as the brick.
+ */
+class Brick {
+private:
+  struct Arrival { int64_t at; byte bytes[MAXTELEGRAM]; };
+
+  int                     fd;
+  int                     files;
+  int64_t                 latency, service;
+  std::deque<Arrival>     arrivals;
+  std::mutex              lock;
+  std::condition_variable arrived;
+
+  void receive() {
+    Arrival a;
+    while (readTelegram(fd, a.bytes) > 0) {
+      a.at = now();
+      std::lock_guard<std::mutex> locker(lock);
+      arrivals.push_back(a);
+      arrived.notify_one();
+    }
+  }
+
+  void answer() {
+    int next = 0;
+    int64_t last = 0;
+    for (;;) {
+      Arrival a;
+      {
+        std::unique_lock<std::mutex> locker(lock);
+        arrived.wait(locker, [this] { return !arrivals.empty(); });
+        a = arrivals.front();
+        arrivals.pop_front();
+      }
+      if (a.bytes[2] & 0x80) continue;                // no reply asked
+      byte out[MAXTELEGRAM];
+      memset(out, 0, sizeof(out));
+      int size = 5;
+      out[2] = REPLY;
+      out[3] = a.bytes[3];
+      out[4] = STATUS_SUCCESS;
+      if (a.bytes[3] == OP_FINDFIRST || a.bytes[3] == OP_FINDNEXT) {
+        if (a.bytes[3] == OP_FINDFIRST) next = 0;
+        size = 2 + 8 + FILENAMEWIDTH;
+        if (next < files) {
+          out[5] = 1;                                 // handle
+          snprintf((char*)out + 6, FILENAMEWIDTH, "file%03d.rxe", next);
+          out[6 + FILENAMEWIDTH] = (next * 100) & 0xFF;
+          next++;
+        }
+        else {
+          out[4] = STATUS_FILENOTFOUND;
+        }
+      }
+      out[0] = size - 2;
+      int64_t due = std::max(a.at + latency, last + service);
+      sleepUntil(due);
+      last = due;
+      if (!writeAll(fd, out, size)) return;
+    }
+  }
+
+public:
+  Brick(int f, int count, int l, int s)
+    : fd(f), files(count), latency(l*1000000LL), service(s*1000000LL) {
+    std::thread(&Brick::receive, this).detach();
+    std::thread(&Brick::answer, this).detach();
+  }
+};
+
+/** ------------------------------------------------------------------------
+ * @brief list function make a list with "window" requests in flight, as
+ * Files::fill does, and wait replies of requests sent after the end.
+ * @return count of files, or -1 on error
+ */
+static int list(int fd, int window) {
+  byte out[MAXTELEGRAM], in[MAXTELEGRAM];
+  int size = encode(FindFirst("*.*"), out, MAXTELEGRAM);
+  if (!writeAll(fd, out, size)) return -1;
+  int found = 0, flying = 1;
+  bool finished = false;
+  byte handle = 0;
+  while (flying > 0) {
+    if (readTelegram(fd, in) == 0) return -1;
+    flying--;
+    FindReply reply(in + 2, in[0] | (in[1] << 8));
+    if (finished) continue;
+    if (!reply.valid() || !reply.ok()) {
+      finished = true;
+      continue;
+    }
+    found++;
+    if (reply.command() == OP_FINDFIRST) handle = reply.handle();
+    while (flying < window) {
+      size = encode(FindNext(handle), out, MAXTELEGRAM);
+      if (!writeAll(fd, out, size)) return -1;
+      flying++;
+    }
+  }
+  size = encode(Close(handle), out, MAXTELEGRAM, false);
+  writeAll(fd, out, size);
+  return found;
+}
+
+int main(int argCount, char* argValues[]) {
+  int files   = argCount > 1 ? std::max(0, atoi(argValues[1])) : 30;
+  int latency = argCount > 2 ? atoi(argValues[2]) : 30;
+  int service = argCount > 3 ? atoi(argValues[3]) : 2;
+  int window  = argCount > 4 ? std::max(1, atoi(argValues[4])) : 8;
+
+  int pair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+    perror("socketpair");
+    return 1;
+  }
+  new Brick(pair[1], files, latency, service);
+  printf("%d files, latency %d ms, service %d ms\n", files, latency,
+         service);
+  int windows[2] = { 1, window };
+  double times[2];
+  for (int i=0; i<2; i++) {
+    int64_t start = now();
+    int found = list(pair[0], windows[i]);
+    times[i] = (now() - start) / 1e6;
+    if (found != files) {
+      fprintf(stderr, "window %d: %d files listed\n", windows[i], found);
+      return 1;
+    }
+    printf("window %2d: %4.0f ms, %.1f ms per file\n", windows[i],
+           times[i], times[i] / std::max(1, files));
+  }
+  printf("speedup %.1fx\n", times[0] / times[1]);
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <vector>
+
+#include <network.h>
+
+/** ========================================================================
+ * @brief lanes tool measure the latency of stops through the lanes of
+ * Network (network.h) while a bulk upload saturates the link, against a
+ * brick stand-in of the same process on a socketpair.
+ *   lanes [SECONDS [LINK [BUDGET]]]
+ *       during SECONDS (10 by default) the stand-in takes LINK bytes per
+ *       second (8000), as a slow Bluetooth link; BUDGET is the bytes per
+ *       second of bulk lane (Network::BULKBUDGET by default, 0 unlimited)
+ * Traffic: WRITE telegrams of an upload keep bulk lane full, port B gets
+ * a new power 100 times per second in setpoint lane, and every 100 ms port
+ * A gets a power and, some ms later, its stop in safety lane (both carry
+ * the number of the cycle as tacho limit, to be told apart).  Reported:
+ * latency of stops from queueing until the stand-in read them (median,
+ * p99, worst) and powers of port A that arrived after their own stop,
+ * which must be zero.  Without budget the writes block in the kernel and
+ * all lanes fill, the worst case for the order of stops.
+ *
+ * To build it (Qt core and BlueZ headers are needed by network.h):
+ *   g++ -O2 -fPIC -I.. `pkg-config --cflags Qt5Core` -o lanes lanes.cpp
+ *       `pkg-config --libs Qt5Core` -lbluetooth -lpthread
+ */
+
+enum { CYCLE = 100 };                 // ms between stops of port A
+
+static QMutex              lock;
+static std::vector<qint64> queuedAt;  // by cycle, 0 when not queued
+static std::vector<double> latencies; // ms, of stops arrived
+static long                stale = 0, bulkBytes = 0, setpoints = 0;
+
+/** ------------------------------------------------------------------------
+ * @brief Brick class read telegrams at LINK bytes per second, answer the
+ * ones asking reply, and check the powers of port A against its stops.
+ */
+class Brick : public QThread {
+public:
+  int fd;
+  int link;
+
+protected:
+  void run() {
+    byte buffer[MAXTELEGRAM];
+    qint64 free = monotonic();           // when the link is idle again
+    quint32 stopped = 0;                  // last cycle stopped
+    for (;;) {
+      int got = 0;
+      while (got < 2) {
+        int n = read(fd, buffer + got, 2 - got);
+        if (n <= 0) return;
+        got += n;
+      }
+      int size = (buffer[0] | (buffer[1] << 8)) + 2;
+      if (size > MAXTELEGRAM) return;
+      while (got < size) {
+        int n = read(fd, buffer + got, size - got);
+        if (n <= 0) return;
+        got += n;
+      }
+      free = qMax(free, monotonic()) + (qint64)size*1000000000LL/link;
+      struct timespec wake;
+      wake.tv_sec  = free / 1000000000LL;
+      wake.tv_nsec = free % 1000000000LL;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+
+      byte opcode = buffer[3];
+      QMutexLocker locker(&lock);
+      if (opcode == OP_SETOUTPUTSTATE && buffer[4] == PORT_A) {
+        quint32 owner = buffer[10] | (buffer[11] << 8) | (buffer[12] << 16) |
+                        ((quint32)buffer[13] << 24);
+        if (buffer[5] != 0) {
+          if (owner <= stopped) stale++;   // its stop arrived before
+        }
+        else if (owner > stopped) {       // copies of a stop come later
+          stopped = owner;
+          if (owner < queuedAt.size() && queuedAt[owner] > 0) {
+            latencies.push_back((monotonic() - queuedAt[owner]) / 1e6);
+          }
+        }
+      }
+      else if (opcode == OP_SETOUTPUTSTATE) {
+        setpoints++;
+      }
+      else if (opcode == OP_WRITE) {
+        bulkBytes += size;
+      }
+      if (buffer[2] & 0x80) continue;
+      int answer = opcode == OP_WRITE ? 8 : 5;  // handle and count
+      byte reply[8] = { (byte)(answer - 2), 0, REPLY, opcode, STATUS_SUCCESS,
+                        buffer[4], (byte)(size - 6), 0 };
+      if (write(fd, reply, answer) < 0) return;
+    }
+  }
+};
+
+static void sleepUntil(qint64 deadline) {
+  struct timespec wake;
+  wake.tv_sec  = deadline / 1000000000LL;
+  wake.tv_nsec = deadline % 1000000000LL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+}
+
+/** ------------------------------------------------------------------------
+ * @brief Upload class keep bulk lane full of WRITE telegrams.
+ */
+class Upload : public QThread {
+public:
+  Network*   net;
+  QAtomicInt running;
+
+protected:
+  void run() {
+    byte chunk[59];
+    memset(chunk, 0x55, sizeof(chunk));
+    Telegram t(Write(1, chunk, sizeof(chunk)));
+    while (running.load()) {
+      if (!net->directCommand(t, Network::BULK)) msleep(2);
+    }
+  }
+};
+
+int main(int argCount, char* argValues[]) {
+  signal(SIGPIPE, SIG_IGN);
+  int seconds = argCount > 1 ? qMax(1, atoi(argValues[1])) : 10;
+  int link    = argCount > 2 ? qMax(100, atoi(argValues[2])) : 8000;
+  int budget  = argCount > 3 ? atoi(argValues[3]) : Network::BULKBUDGET;
+
+  int pair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+    perror("socketpair");
+    return 1;
+  }
+  int small = 4096;                       // as the RFCOMM socket buffer
+  setsockopt(pair[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+  setsockopt(pair[1], SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+
+  Network net;
+  net.setBulkBudget(budget);
+  net.bindSocket(pair[0], "stand-in");
+  Brick brick;
+  brick.fd = pair[1];
+  brick.link = link;
+  brick.start();
+  Upload upload;
+  upload.net = &net;
+  upload.running.store(1);
+  upload.start();
+
+  qint64 start = monotonic();
+  qint64 end = start + seconds*1000000000LL;
+  qint64 tick = start;
+  quint32 c = 0;
+  for (int t=0; tick < end; t++) {
+    tick += 10000000LL;                   // 100 Hz
+    sleepUntil(tick);
+    net.directCommand(Telegram(SetOutputState(PORT_B, 20 + t % 60)));
+    int phase = t % (CYCLE / 10);
+    if (phase == 0) {
+      c++;
+      net.directCommand(Telegram(SetOutputState(PORT_A, 75, MODE_MOTORON,
+                        REGULATION_IDLE, 0, RUNSTATE_RUNNING, c)));
+    }
+    else if (phase == 1 + (t / (CYCLE / 10)) % 5) {  // 10..50 ms later
+      QMutexLocker locker(&lock);
+      queuedAt.resize(c + 1, 0);
+      queuedAt[c] = monotonic();
+      if (!net.directCommand(Telegram(SetOutputState(PORT_A, 0,
+                             MODE_MOTORON|MODE_BRAKE, REGULATION_IDLE, 0,
+                             RUNSTATE_RUNNING, c)), Network::SAFETY)) {
+        queuedAt[c] = 0;
+      }
+    }
+  }
+  QThread::msleep(1000);                  // last stops still on the link
+  upload.running.store(0);
+  upload.wait();
+
+  QMutexLocker locker(&lock);
+  double elapsed = (monotonic() - start) / 1e9;
+  printf("link %d B/s, bulk budget %d B/s, %d s\n", link, budget, seconds);
+  printf("bulk %.0f B/s, setpoints %.0f per second\n", bulkBytes / elapsed,
+         setpoints / elapsed);
+  std::vector<double> v = latencies;
+  std::sort(v.begin(), v.end());
+  int n = v.size();
+  int queued = 0;
+  for (size_t i=0; i<queuedAt.size(); i++) if (queuedAt[i] > 0) queued++;
+  printf("stops %d of %d arrived\n", n, queued);
+  if (n > 0) {
+    printf("stop latency (ms): median %.1f  p99 %.1f  worst %.1f\n",
+           v[n/2], v[(n-1)*99/100], v[n-1]);
+  }
+  printf("powers of port A after their stop: %ld\n", stale);
+  fflush(stdout);
+  _exit(stale > 0 || n == 0 ? 1 : 0);     // stand-in still blocked in read
+}
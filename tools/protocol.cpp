@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <protocol.h>
+
+/** ========================================================================
+ * @brief protocol tool check the codec of protocol.h against a fixed corpus
+ * of telegrams written from the tables of the NXT Bluetooth Developer Kit,
+ * and measure its speed.
+ *   protocol           check corpus and time 10 million encodes/decodes
+ *   protocol COUNT     same with COUNT of each
+ * Every request struct is encoded and compared byte by byte, every reply
+ * view is read over its bytes.  Exit status is 1 when something differs.
+ *
+ * To build it: g++ -O2 -I.. -o protocol protocol.cpp
+ */
+
+static int checked = 0, failed = 0;
+
+/** ------------------------------------------------------------------------
+ * @brief parse function convert hexadecimal bytes separated by spaces,
+ * "00*15" repeats a byte 15 times.
+ * @return count of bytes
+ */
+static int parse(const char* text, byte* out, int capacity) {
+  int count = 0;
+  while (*text) {
+    if (*text == ' ') { text++; continue; }
+    char* end;
+    int value = strtol(text, &end, 16);
+    int times = 1;
+    if (*end == '*') times = strtol(end+1, &end, 10);
+    for (int i=0; i<times && count<capacity; i++) out[count++] = value;
+    text = end;
+  }
+  return count;
+}
+
+static void dump(const byte* bytes, int count) {
+  for (int i=0; i<count; i++) printf(" %02X", bytes[i]);
+  printf("\n");
+}
+
+/** ------------------------------------------------------------------------
+ * @brief encoded function compare the telegram of "request" with
+ * "expected", length bytes included.
+ */
+template <class Request>
+static void encoded(const char* name, const Request& request,
+                    const char* expected, bool reply = Request::replies) {
+  byte buffer[MAXTELEGRAM], wanted[MAXTELEGRAM];
+  int size = encode(request, buffer, MAXTELEGRAM, reply);
+  int count = parse(expected, wanted, MAXTELEGRAM);
+  checked++;
+  if (size == count && memcmp(buffer, wanted, count) == 0) return;
+  failed++;
+  printf("FAIL encode %s\n  got     ", name);
+  dump(buffer, size);
+  printf("  wanted  ");
+  dump(wanted, count);
+}
+
+static void expect(const char* name, bool condition) {
+  checked++;
+  if (condition) return;
+  failed++;
+  printf("FAIL decode %s\n", name);
+}
+
+// file names of the corpus, padded to their fields
+#define NAME      "61 2E 72 78 65 00*15"                      // "a.rxe"
+#define MODULE    "43 6F 6D 6D 61 6E 64 2E 6D 6F 64 00*9"     // "Command.mod"
+#define BRICK     "4E 58 54 00*13"                            // "NXT"
+#define DEVICE    "4E 58 54 00*12"
+
+/** ------------------------------------------------------------------------
+ * @brief requests function encode every request of the kit.
+ */
+static void requests() {
+  const byte hi[3] = { 'h', 'i', 0 };
+  const byte i2c[2] = { 0x02, 0x42 };
+  const byte data[3] = { 1, 2, 3 };
+  const byte map[2] = { 0xAA, 0xBB };
+  byte big[MAXCOMMAND], buffer[MAXTELEGRAM];
+  memset(big, 0, sizeof(big));
+
+  // direct commands
+  encoded("StartProgram", StartProgram("a.rxe"), "16 00 80 00 " NAME);
+  encoded("StopProgram", StopProgram(), "02 00 80 01");
+  encoded("PlaySoundFile", PlaySoundFile("a.rxe", true),
+          "17 00 80 02 01 " NAME);
+  encoded("PlayTone", PlayTone(440, 500), "06 00 80 03 B8 01 F4 01");
+  encoded("SetOutputState",
+          SetOutputState(PORT_B, -75, MODE_MOTORON|MODE_REGULATED,
+                         REGULATION_SPEED, 0, RUNSTATE_RUNNING, 360),
+          "0C 00 80 04 01 B5 05 01 00 20 68 01 00 00");
+  encoded("SetInputMode",
+          SetInputMode(0, SENSOR_SWITCH, SENSORMODE_BOOLEAN),
+          "05 00 80 05 00 01 20");
+  encoded("GetOutputState", GetOutputState(2), "03 00 00 06 02");
+  encoded("GetInputValues", GetInputValues(3), "03 00 00 07 03");
+  encoded("ResetInputScaledValue", ResetInputScaledValue(1),
+          "03 00 80 08 01");
+  encoded("MessageWrite", MessageWrite(1, hi, 3),
+          "07 00 80 09 01 03 68 69 00");
+  encoded("ResetMotorPosition", ResetMotorPosition(PORT_A, true),
+          "04 00 80 0A 00 01");
+  encoded("GetBatteryLevel", GetBatteryLevel(), "02 00 00 0B");
+  encoded("StopSoundPlayback", StopSoundPlayback(), "02 00 80 0C");
+  encoded("KeepAlive", KeepAlive(), "02 00 00 0D");
+  encoded("LSGetStatus", LSGetStatus(3), "03 00 00 0E 03");
+  encoded("LSWrite", LSWrite(3, i2c, 2, 1), "07 00 80 0F 03 02 01 02 42");
+  encoded("LSRead", LSRead(3), "03 00 00 10 03");
+  encoded("GetCurrentProgramName", GetCurrentProgramName(),
+          "02 00 00 11");
+  encoded("MessageRead", MessageRead(10, 0, true), "05 00 00 13 0A 00 01");
+
+  // system commands
+  encoded("OpenRead", OpenRead("a.rxe"), "16 00 01 80 " NAME);
+  encoded("OpenWrite", OpenWrite("a.rxe", 0x12345678),
+          "1A 00 01 81 " NAME " 78 56 34 12");
+  encoded("Read", Read(5, 100), "05 00 01 82 05 64 00");
+  encoded("Write", Write(5, data, 3), "06 00 01 83 05 01 02 03");
+  encoded("Close", Close(5), "03 00 01 84 05");
+  encoded("Delete", Delete("a.rxe"), "16 00 01 85 " NAME);
+  encoded("FindFirst", FindFirst("a.rxe"), "16 00 01 86 " NAME);
+  encoded("FindNext", FindNext(5), "03 00 01 87 05");
+  encoded("GetFirmwareVersion", GetFirmwareVersion(), "02 00 01 88");
+  encoded("OpenWriteLinear", OpenWriteLinear("a.rxe", 1024),
+          "1A 00 01 89 " NAME " 00 04 00 00");
+  encoded("OpenReadLinear", OpenReadLinear("a.rxe"), "16 00 01 8A " NAME);
+  encoded("OpenWriteData", OpenWriteData("a.rxe", 1024),
+          "1A 00 01 8B " NAME " 00 04 00 00");
+  encoded("OpenAppendData", OpenAppendData("a.rxe"), "16 00 01 8C " NAME);
+  encoded("RequestFirstModule", RequestFirstModule("a.rxe"),
+          "16 00 01 90 " NAME);
+  encoded("RequestNextModule", RequestNextModule(5), "03 00 01 91 05");
+  encoded("CloseModuleHandle", CloseModuleHandle(5), "03 00 01 92 05");
+  encoded("ReadIOMap", ReadIOMap(0x00010001, 0x10, 0x20),
+          "0A 00 01 94 01 00 01 00 10 00 20 00");
+  encoded("WriteIOMap", WriteIOMap(0x00010001, 0x10, map, 2),
+          "0C 00 01 95 01 00 01 00 10 00 02 00 AA BB");
+  encoded("BootCommand", BootCommand(),
+          "15 00 01 97 4C 65 74 27 73 20 64 61 6E 63 65 3A 20 "
+          "53 41 4D 42 41 00");
+  encoded("SetBrickName", SetBrickName("NXT"), "12 00 01 98 " BRICK);
+  encoded("GetDeviceInfo", GetDeviceInfo(), "02 00 01 9B");
+  encoded("DeleteUserFlash", DeleteUserFlash(), "02 00 01 A0");
+  encoded("PollCommandLength", PollCommandLength(0), "03 00 01 A1 00");
+  encoded("PollCommand", PollCommand(0, 10), "04 00 01 A2 00 0A");
+  encoded("BluetoothFactoryReset", BluetoothFactoryReset(), "02 00 01 A4");
+
+  // reply asked or not against the default of command
+  encoded("GetBatteryLevel without reply", GetBatteryLevel(),
+          "02 00 80 0B", false);
+  encoded("PlayTone with reply", PlayTone(440, 500),
+          "06 00 00 03 B8 01 F4 01", true);
+  encoded("Close without reply", Close(5), "03 00 81 84 05", false);
+
+  // telegrams that do not fit
+  checked++;
+  if (encode(Write(5, big, MAXCOMMAND), buffer, MAXTELEGRAM) != 0 ||
+      encode(OpenRead("a.rxe"), buffer, 10) != 0) {
+    failed++;
+    printf("FAIL encode oversized\n");
+  }
+}
+
+/** ------------------------------------------------------------------------
+ * @brief replies function read every reply view over its bytes (length
+ * bytes not included, as Network gives them).
+ */
+static void replies() {
+  byte b[MAXTELEGRAM];
+  int n;
+
+  n = parse("02 06 00 01 B5 05 01 00 20 68 01 00 00 2C 01 00 00 "
+            "2C 01 00 00 D4 FE FF FF", b, MAXTELEGRAM);
+  OutputStateReply output(b, n);
+  expect("OutputState", output.valid() && output.ok() &&
+         output.port() == 1 && output.power() == -75 &&
+         output.mode() == 5 && output.regulation() == REGULATION_SPEED &&
+         output.turnRatio() == 0 && output.runState() == RUNSTATE_RUNNING &&
+         output.tachoLimit() == 360 && output.tachoCount() == 300 &&
+         output.blockTachoCount() == 300 && output.rotationCount() == -300);
+  expect("OutputState short", !OutputStateReply(b, n-1).valid());
+
+  n = parse("02 07 00 00 01 00 01 20 FF 03 00 00 01 00 00 00", b,
+            MAXTELEGRAM);
+  InputValuesReply input(b, n);
+  expect("InputValues", input.valid() && input.port() == 0 &&
+         input.validData() && !input.calibrated() &&
+         input.type() == SENSOR_SWITCH &&
+         input.mode() == SENSORMODE_BOOLEAN && input.raw() == 1023 &&
+         input.normalized() == 0 && input.scaled() == 1 &&
+         input.calibratedValue() == 0);
+
+  n = parse("02 0B 00 5A 1F", b, MAXTELEGRAM);
+  expect("BatteryLevel", BatteryLevelReply(b, n).valid() &&
+         BatteryLevelReply(b, n).millivolts() == 8026);
+  expect("BatteryLevel short", !BatteryLevelReply(b, n-1).valid());
+  expect("BatteryLevel as KeepAlive", !KeepAliveReply(b, n).valid());
+
+  n = parse("02 0D 00 60 EA 00 00", b, MAXTELEGRAM);
+  expect("KeepAlive", KeepAliveReply(b, n).valid() &&
+         KeepAliveReply(b, n).sleepTime() == 60000);
+
+  n = parse("02 0E 00 02", b, MAXTELEGRAM);
+  expect("LSStatus", LSStatusReply(b, n).valid() &&
+         LSStatusReply(b, n).bytesReady() == 2);
+
+  n = parse("02 10 00 02 12 34 00*14", b, MAXTELEGRAM);
+  LSReadReply ls(b, n);
+  expect("LSRead", ls.valid() && ls.bytesRead() == 2 &&
+         ls.rxData()[0] == 0x12 && ls.rxData()[1] == 0x34);
+
+  n = parse("02 11 00 " NAME, b, MAXTELEGRAM);
+  expect("ProgramName", ProgramNameReply(b, n).valid() &&
+         strcmp(ProgramNameReply(b, n).filename(), "a.rxe") == 0);
+
+  n = parse("02 13 00 00 03 68 69 00 00*56", b, MAXTELEGRAM);
+  MessageReadReply message(b, n);
+  expect("MessageRead", message.valid() && message.localInbox() == 0 &&
+         message.size() == 3 &&
+         strcmp((const char*)message.message(), "hi") == 0);
+
+  n = parse("02 81 00 05", b, MAXTELEGRAM);
+  expect("OpenWrite", HandleReply(b, n).valid(OP_OPENWRITE) &&
+         HandleReply(b, n).handle() == 5 &&
+         !HandleReply(b, n).valid(OP_CLOSE));
+
+  n = parse("02 84 00 05", b, MAXTELEGRAM);
+  expect("Close", HandleReply(b, n).valid(OP_CLOSE) &&
+         HandleReply(b, n).handle() == 5);
+
+  n = parse("02 80 00 05 00 04 00 00", b, MAXTELEGRAM);
+  expect("OpenRead", OpenReply(b, n).valid(OP_OPENREAD) &&
+         OpenReply(b, n).handle() == 5 && OpenReply(b, n).size() == 1024);
+
+  n = parse("02 8C 00 05 00 02 00 00", b, MAXTELEGRAM);
+  expect("OpenAppendData", OpenReply(b, n).valid(OP_OPENAPPENDDATA) &&
+         OpenReply(b, n).size() == 512);
+
+  n = parse("02 82 00 05 03 00 01 02 03", b, MAXTELEGRAM);
+  ReadReply read(b, n);
+  expect("Read", read.valid() && read.handle() == 5 && read.count() == 3 &&
+         read.bytes()[0] == 1 && read.bytes()[2] == 3);
+  n = parse("02 82 00 05 05 00 01 02", b, MAXTELEGRAM);
+  expect("Read truncated", !ReadReply(b, n).valid());
+
+  n = parse("02 83 00 05 03 00", b, MAXTELEGRAM);
+  expect("Write", WriteReply(b, n).valid() &&
+         WriteReply(b, n).handle() == 5 && WriteReply(b, n).written() == 3);
+
+  n = parse("02 85 00 " NAME, b, MAXTELEGRAM);
+  expect("Delete", DeleteReply(b, n).valid() &&
+         strcmp(DeleteReply(b, n).filename(), "a.rxe") == 0);
+  n = parse("02 85 87", b, MAXTELEGRAM);
+  expect("Delete not found", DeleteReply(b, n).valid() &&
+         !DeleteReply(b, n).ok() &&
+         DeleteReply(b, n).status() == STATUS_FILENOTFOUND);
+
+  n = parse("02 86 00 05 " NAME " 00 04 00 00", b, MAXTELEGRAM);
+  FindReply find(b, n);
+  expect("FindFirst", find.valid() && find.command() == OP_FINDFIRST &&
+         find.handle() == 5 && strcmp(find.filename(), "a.rxe") == 0 &&
+         find.fileSize() == 1024);
+  b[1] = OP_FINDNEXT;
+  expect("FindNext", FindReply(b, n).valid());
+  n = parse("02 87 83", b, MAXTELEGRAM);
+  expect("FindNext no more files", FindReply(b, n).valid() &&
+         FindReply(b, n).status() == STATUS_NOMOREFILES);
+
+  n = parse("02 88 00 7C 01 1C 01", b, MAXTELEGRAM);
+  FirmwareVersionReply version(b, n);
+  expect("FirmwareVersion", version.valid() &&
+         version.protocolMajor() == 1 && version.protocolMinor() == 124 &&
+         version.firmwareMajor() == 1 && version.firmwareMinor() == 28);
+
+  n = parse("02 8A 00 00 80 10 00", b, MAXTELEGRAM);
+  expect("OpenReadLinear", OpenReadLinearReply(b, n).valid() &&
+         OpenReadLinearReply(b, n).pointer() == 0x00108000);
+
+  n = parse("02 90 00 00 " MODULE " 01 00 01 00 00 80 00 00 1C 00", b,
+            MAXTELEGRAM);
+  ModuleReply module(b, n);
+  expect("RequestFirstModule", module.valid() && module.handle() == 0 &&
+         strcmp(module.name(), "Command.mod") == 0 &&
+         module.module() == 0x00010001 && module.size() == 32768 &&
+         module.ioMapSize() == 28);
+
+  n = parse("02 94 00 01 00 01 00 02 00 AA BB", b, MAXTELEGRAM);
+  ReadIOMapReply ioread(b, n);
+  expect("ReadIOMap", ioread.valid() && ioread.module() == 0x00010001 &&
+         ioread.count() == 2 && ioread.bytes()[1] == 0xBB);
+  expect("ReadIOMap truncated", !ReadIOMapReply(b, n-1).valid());
+
+  n = parse("02 95 00 01 00 01 00 02 00", b, MAXTELEGRAM);
+  expect("WriteIOMap", WriteIOMapReply(b, n).valid() &&
+         WriteIOMapReply(b, n).module() == 0x00010001 &&
+         WriteIOMapReply(b, n).written() == 2);
+
+  n = parse("02 97 00 59 65 73 00", b, MAXTELEGRAM);
+  expect("BootCommand", BootReply(b, n).valid() &&
+         strcmp(BootReply(b, n).answer(), "Yes") == 0);
+
+  n = parse("02 98 00", b, MAXTELEGRAM);
+  expect("SetBrickName", Reply(b, n).valid(OP_SETBRICKNAME) &&
+         Reply(b, n).ok());
+
+  n = parse("02 9B 00 " DEVICE " 00 16 53 01 02 03 00 00 00 00 00 "
+            "00 80 01 00", b, MAXTELEGRAM);
+  DeviceInfoReply device(b, n);
+  expect("DeviceInfo", device.valid() && strcmp(device.name(), "NXT") == 0 &&
+         device.address()[1] == 0x16 && device.address()[5] == 0x03 &&
+         device.signal() == 0 && device.freeFlash() == 98304);
+
+  n = parse("02 A1 00 00 0A", b, MAXTELEGRAM);
+  expect("PollCommandLength", PollLengthReply(b, n).valid() &&
+         PollLengthReply(b, n).buffer() == 0 &&
+         PollLengthReply(b, n).count() == 10);
+
+  n = parse("02 A2 00 00 02 01 02", b, MAXTELEGRAM);
+  expect("PollCommand", PollReply(b, n).valid() &&
+         PollReply(b, n).count() == 2 && PollReply(b, n).command()[1] == 2);
+
+  n = parse("02 0B", b, MAXTELEGRAM);
+  expect("too short", !Reply(b, n).valid(OP_GETBATTERYLEVEL) &&
+         !Reply(b, n).ok());
+
+  n = parse("05 00 02 0B 00 5A 1F 02 00", b, MAXTELEGRAM);
+  expect("telegramLength", telegramLength(b, n) == 7 &&
+         telegramLength(b, 6) == 0 && telegramLength(b, 1) == 0);
+}
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/** ------------------------------------------------------------------------
+ * @brief bench function time the telegrams most sent and received: a
+ * SetOutputState and the reply of GetOutputState.  A checksum keeps the
+ * compiler from removing the work.
+ */
+static void bench(long count) {
+  byte buffer[MAXTELEGRAM], reply[MAXTELEGRAM];
+  int n = parse("02 06 00 01 B5 05 01 00 20 68 01 00 00 2C 01 00 00 "
+                "2C 01 00 00 D4 FE FF FF", reply, MAXTELEGRAM);
+  volatile unsigned sink = 0;
+  unsigned sum = 0;
+  long bytes = 0;
+
+  double start = seconds();
+  for (long i=0; i<count; i++) {
+    int size = encode(SetOutputState(i % 3, (signed char)(i % 201 - 100)),
+                      buffer, MAXTELEGRAM);
+    sum += buffer[5] + size;
+    bytes += size;
+  }
+  double elapsed = seconds() - start;
+  sink = sum;
+  printf("encode SetOutputState: %.1f ns each, %.0f MB/s\n",
+         elapsed * 1e9 / count, bytes / elapsed / 1e6);
+
+  start = seconds();
+  sum = 0;
+  for (long i=0; i<count; i++) {
+    reply[4] = (byte) i;
+    OutputStateReply r(reply, n);
+    if (r.valid()) sum += r.power() + r.tachoCount() + r.rotationCount();
+  }
+  elapsed = seconds() - start;
+  sink = sum;
+  printf("decode OutputStateReply: %.1f ns each, %.0f MB/s\n",
+         elapsed * 1e9 / count, (double)n * count / elapsed / 1e6);
+  (void) sink;
+}
+
+int main(int argCount, char* argValues[]) {
+  long count = argCount > 1 ? atol(argValues[1]) : 10000000L;
+  requests();
+  replies();
+  printf("%d checks, %d failed\n", checked, failed);
+  if (count > 0) bench(count);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <protocol.h>
+
+/** ========================================================================
+ * @brief relayload tool load the relay mode of NXT PC Remote Control with
+ * many clients and check that every reply goes back to its client.
+ *   relayload brick PATH [LATENCY]
+ *       brick stand-in on Unix socket PATH, answering after LATENCY ms
+ *       (15 by default) in order, as the brick does
+ *   relayload clients N [SECONDS [LATENCY [PORT]]]
+ *       N clients on 127.0.0.1:PORT (9027 by default) during SECONDS
+ * Run the stand-in, then "nxt-pc-remote-control --relay PATH", then the
+ * clients.  Each client keeps one READ IOMAP in flight, with its number and
+ * a sequence as module id, followed by a SETOUTPUTSTATE without reply; the
+ * stand-in echoes the module id, so a reply of other client or out of
+ * order is seen.  At the end each client sends its last request and closes
+ * its side, it must still get the reply.  Round trip minus LATENCY is the
+ * time added by the relay.
+ *
+ * To build it: g++ -O2 -I.. -o relayload relayload.cpp
+ */
+
+static int64_t now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec*1000000000LL + t.tv_nsec;
+}
+
+static bool writeAll(int fd, const byte* bytes, int count) {
+  while (count > 0) {
+    int n = write(fd, bytes, count);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    bytes += n;
+    count -= n;
+  }
+  return true;
+}
+
+/** ------------------------------------------------------------------------
+ * @brief brick function serve one relay as a brick with constant latency.
+ * Replies keep the order of requests; READ IOMAP echoes its module id, the
+ * rest get a bare success.
+ */
+static int brick(const char* path, int latency) {
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  unlink(path);
+  if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(listener, 1) < 0) {
+    perror(path);
+    return 1;
+  }
+  printf("brick stand-in on %s, latency %d ms\n", path, latency);
+  fflush(stdout);
+  int fd = accept(listener, NULL, NULL);
+  close(listener);
+  unlink(path);
+
+  struct Answer { int64_t due; byte bytes[MAXTELEGRAM]; int size; };
+  std::deque<Answer> answers;
+  byte input[4096];
+  int inputSize = 0;
+  long requests = 0;
+  for (;;) {
+    int wait = -1;
+    if (!answers.empty()) {
+      wait = std::max<int64_t>(0, (answers.front().due - now()) / 1000000);
+    }
+    struct pollfd p = { fd, POLLIN, 0 };
+    if (poll(&p, 1, wait) < 0 && errno != EINTR) break;
+    if (p.revents) {
+      int n = read(fd, input + inputSize, sizeof(input) - inputSize);
+      if (n <= 0) break;
+      inputSize += n;
+      int size;
+      while ((size = telegramLength(input, inputSize)) > 0) {
+        if (size >= 4 && !(input[2] & 0x80)) {
+          Answer a;
+          a.due = now() + latency*1000000LL;
+          a.size = 5;
+          a.bytes[2] = REPLY;
+          a.bytes[3] = input[3];
+          a.bytes[4] = STATUS_SUCCESS;
+          if (input[3] == OP_READIOMAP && size >= 8) {
+            memcpy(a.bytes + 5, input + 4, 4);        // module id
+            a.bytes[9] = a.bytes[10] = 0;             // no bytes read
+            a.size = 11;
+          }
+          a.bytes[0] = a.size - 2;
+          a.bytes[1] = 0;
+          answers.push_back(a);
+        }
+        requests++;
+        memmove(input, input + size, inputSize - size);
+        inputSize -= size;
+      }
+    }
+    while (!answers.empty() && answers.front().due <= now()) {
+      if (!writeAll(fd, answers.front().bytes, answers.front().size)) break;
+      answers.pop_front();
+    }
+  }
+  printf("relay gone after %ld telegrams\n", requests);
+  return 0;
+}
+
+struct Client {
+  int      fd;
+  uint16_t sequence;        // of request in flight
+  int64_t  sent;
+  bool     flying;
+  bool     closed;          // last request sent and side closed
+  bool     finished;        // last reply arrived
+  byte     input[256];
+  int      inputSize;
+};
+
+/** ------------------------------------------------------------------------
+ * @brief request function send the next READ IOMAP of client "k", and a
+ * telegram without reply that the relay must not count.
+ */
+static bool request(Client& c, int k) {
+  byte out[2*MAXTELEGRAM];
+  int size = encode(ReadIOMap(((uint32_t)k << 16) | c.sequence, 0, 0), out,
+                    MAXTELEGRAM);
+  size += encode(SetOutputState(PORT_A, 0), out + size, MAXTELEGRAM, false);
+  c.sent = now();
+  c.flying = true;
+  return writeAll(c.fd, out, size);
+}
+
+static int clients(int count, int seconds, int latency, int port) {
+  std::vector<Client> all(count);
+  std::vector<struct pollfd> polls(count);
+  std::vector<int64_t> trips;
+  long misrouted = 0, failed = 0;
+  for (int k=0; k<count; k++) {
+    Client& c = all[k];
+    memset(&c, 0, sizeof(c));
+    c.fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(c.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+      perror("connecting relay");
+      return 1;
+    }
+    int yes = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    polls[k].fd = c.fd;
+    polls[k].events = POLLIN;
+  }
+
+  int64_t start = now(), end = start + seconds*1000000000LL;
+  int finished = 0;
+  while (finished < count && now() < end + 10000000000LL) {
+    bool last = now() >= end;
+    for (int k=0; k<count; k++) {
+      Client& c = all[k];
+      if (c.flying || c.closed || c.finished) continue;
+      c.sequence++;
+      if (!request(c, k)) {
+        failed++;
+        c.finished = true;
+        finished++;
+        continue;
+      }
+      if (last) {
+        shutdown(c.fd, SHUT_WR);
+        c.closed = true;
+      }
+    }
+    if (poll(&polls[0], count, 100) < 0 && errno != EINTR) break;
+    for (int k=0; k<count; k++) {
+      Client& c = all[k];
+      if (!polls[k].revents || c.finished) continue;
+      int n = read(c.fd, c.input + c.inputSize,
+                   sizeof(c.input) - c.inputSize);
+      if (n <= 0) {               // relay closed before the last reply
+        failed++;
+        c.finished = true;
+        polls[k].fd = -1;
+        finished++;
+        continue;
+      }
+      c.inputSize += n;
+      int size;
+      while ((size = telegramLength(c.input, c.inputSize)) > 0) {
+        ReadIOMapReply reply(c.input + 2, size - 2);
+        if (!reply.valid() ||
+            reply.module() != (((uint32_t)k << 16) | c.sequence)) {
+          misrouted++;
+        }
+        trips.push_back(now() - c.sent);
+        c.flying = false;
+        memmove(c.input, c.input + size, c.inputSize - size);
+        c.inputSize -= size;
+      }
+      if (c.closed && !c.flying) {
+        c.finished = true;
+        polls[k].fd = -1;
+        finished++;
+      }
+    }
+  }
+  double elapsed = (now() - start) / 1e9;
+  for (int k=0; k<count; k++) close(all[k].fd);
+
+  printf("%d clients, %zu replies in %.1f s, %.0f replies/s\n", count,
+         trips.size(), elapsed, trips.size() / elapsed);
+  printf("misrouted %ld, clients without last reply %ld\n", misrouted,
+         failed + (count - finished));
+  if (trips.empty()) return 1;
+  std::sort(trips.begin(), trips.end());
+  int n = trips.size();
+  printf("round trip (ms): median %.1f  p99 %.1f  max %.1f\n",
+         trips[n/2] / 1e6, trips[(n-1)*99/100] / 1e6, trips[n-1] / 1e6);
+  printf("added by relay (ms): median %.1f  p99 %.1f\n",
+         trips[n/2] / 1e6 - latency, trips[(n-1)*99/100] / 1e6 - latency);
+  return misrouted || failed || finished < count ? 1 : 0;
+}
+
+int main(int argCount, char* argValues[]) {
+  signal(SIGPIPE, SIG_IGN);
+  if (argCount >= 3 && strcmp(argValues[1], "brick") == 0) {
+    return brick(argValues[2], argCount > 3 ? atoi(argValues[3]) : 15);
+  }
+  if (argCount >= 3 && strcmp(argValues[1], "clients") == 0) {
+    return clients(std::max(1, atoi(argValues[2])),
+                   argCount > 3 ? atoi(argValues[3]) : 10,
+                   argCount > 4 ? atoi(argValues[4]) : 15,
+                   argCount > 5 ? atoi(argValues[5]) : 9027);
+  }
+  fprintf(stderr, "usage: relayload brick PATH [LATENCY]\n"
+                  "       relayload clients N [SECONDS [LATENCY [PORT]]]\n");
+  return 1;
+}
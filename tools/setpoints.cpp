@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include <segment.h>
+
+/** ========================================================================
+ * @brief setpoints tool talk with NXT PC Remote Control through its shared
+ * memory segment (menu "External control"), as other programs can do.
+ *   setpoints A B C               put power of motors (-100..100)
+ *   setpoints watch               print telemetry published, 10 per second
+ *   setpoints bench [RATE [SECS]] change setpoints RATE times per second
+ *                                 and report latency until the wire
+ * Bench moves motor A between 30 and -30, robot should be lifted.
+ *
+ * To build it: g++ -O2 -I.. -o setpoints setpoints.cpp -lrt
+ */
+
+static void sleepUntil(int64_t deadline) {
+  struct timespec wake;
+  wake.tv_sec  = deadline / 1000000000LL;
+  wake.tv_nsec = deadline % 1000000000LL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL));
+}
+
+/** ------------------------------------------------------------------------
+ * @brief watch function print each new sample with names of channels.
+ */
+static void watch(SetpointSegment& segment) {
+  int32_t values[SEGMENTCHANNELS];
+  int64_t time, previous = 0, latency;
+  uint32_t applied;
+  for (int64_t next = monotonicNow();; next += 100000000LL) {
+    sleepUntil(next);
+    if (!segment.readTelemetry(time, values, applied, latency) ||
+        time == previous) {
+      continue;
+    }
+    previous = time;
+    for (int c=0; c<segment.channels(); c++) {
+      printf("%s=%d ", segment.name(c), values[c]);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+}
+
+/** ------------------------------------------------------------------------
+ * @brief bench function write setpoints at "rate" and collect the latency
+ * the application measured for each one it sent.  Setpoints replaced
+ * before a tick of application took them are not sent (counted apart).
+ */
+static void bench(SetpointSegment& segment, int rate, int seconds) {
+  std::vector<int64_t> latencies;
+  int32_t values[SEGMENTCHANNELS];
+  int64_t time, latency, writing = 0;
+  uint32_t applied, last = 0;
+  int writes = rate * seconds;
+  int64_t period = 1000000000LL / rate;
+  int64_t next = monotonicNow();
+  for (int i=0; i<writes; i++) {
+    int8_t power[3] = { (int8_t)(i % 2 ? -30 : 30), 0, 0 };
+    int64_t before = monotonicNow();
+    segment.writeSetpoints(power);
+    writing += monotonicNow() - before;
+    next += period;
+    sleepUntil(next);
+    if (segment.readTelemetry(time, values, applied, latency) &&
+        applied != last) {
+      latencies.push_back(latency);
+      last = applied;
+    }
+  }
+  int8_t zero[3] = { 0, 0, 0 };
+  segment.writeSetpoints(zero);
+
+  printf("%d writes, %.0f ns per write, %d sent\n", writes,
+         (double)writing / writes, (int)latencies.size());
+  if (latencies.empty()) return;
+  std::sort(latencies.begin(), latencies.end());
+  int n = latencies.size();
+  printf("latency to wire (us): min %.0f  median %.0f  p99 %.0f  max %.0f\n",
+         latencies[0] / 1e3, latencies[n/2] / 1e3,
+         latencies[(n-1)*99/100] / 1e3, latencies[n-1] / 1e3);
+}
+
+int main(int argCount, char* argValues[]) {
+  SetpointSegment segment;
+  if (argCount < 2) {
+    fprintf(stderr, "usage: setpoints A B C | watch | bench [RATE [SECS]]\n");
+    return 1;
+  }
+  if (!segment.open()) {
+    fprintf(stderr, "%s: not available, enable it in the application\n",
+            SEGMENTNAME);
+    return 1;
+  }
+  if (strcmp(argValues[1], "watch") == 0) {
+    watch(segment);
+  }
+  else if (strcmp(argValues[1], "bench") == 0) {
+    int rate = argCount > 2 ? atoi(argValues[2]) : 100;
+    bench(segment, rate > 0 ? rate : 100,
+          argCount > 3 ? atoi(argValues[3]) : 10);
+  }
+  else if (argCount == 4) {
+    int8_t power[3];
+    for (int i=0; i<3; i++) {
+      power[i] = (int8_t) std::max(-100, std::min(100, atoi(argValues[i+1])));
+    }
+    segment.writeSetpoints(power);
+  }
+  else {
+    fprintf(stderr, "usage: setpoints A B C | watch | bench [RATE [SECS]]\n");
+    return 1;
+  }
+  return 0;
+}
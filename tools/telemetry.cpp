@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include <telemetry.h>
+
+/** ========================================================================
+ * @brief telemetry tool read files recorded by NXT PC Remote Control.
+ *   telemetry FILE                  summary of each channel
+ *   telemetry FILE csv [FROM [TO]]  samples between FROM and TO seconds
+ * Files are read one chunk at a time, memory does not depend on length of
+ * recording.
+ *
+ * To build it: g++ -O2 -I.. -o telemetry telemetry.cpp
+ */
+
+/** ------------------------------------------------------------------------
+ * @brief summary function compute count, minimum, maximum, mean and
+ * standard deviation of every channel, scanning columns.
+ */
+static void summary(TelemetryReader& reader) {
+  int channels = reader.channels();
+  std::vector<int32_t> low(channels, INT32_MAX), high(channels, INT32_MIN);
+  std::vector<double> mean(channels, 0), squares(channels, 0);
+  int64_t first = 0, last = 0;
+  uint64_t n = 0;
+  for (int64_t k=0; k<reader.chunks(); k++) {
+    int rows = reader.load(k);
+    if (rows == 0) break;
+    if (k == 0) first = reader.times()[0];
+    last = reader.times()[rows-1];
+    for (int c=0; c<channels; c++) {
+      const int32_t* column = reader.column(c);
+      uint64_t seen = n;
+      for (int i=0; i<rows; i++) {
+        int32_t value = column[i];
+        if (value < low[c])  low[c] = value;
+        if (value > high[c]) high[c] = value;
+        seen++;
+        double delta = value - mean[c];
+        mean[c] += delta / seen;
+        squares[c] += delta * (value - mean[c]);
+      }
+    }
+    n += rows;
+  }
+
+  double seconds = (last - first) / 1e9;
+  printf("%llu samples, %.1f s", (unsigned long long)n, seconds);
+  if (seconds > 0) printf(", %.1f samples/s", (n - 1) / seconds);
+  printf("\n");
+  if (n == 0) return;
+  printf("%-16s %12s %12s %14s %14s\n", "channel", "min", "max", "mean",
+         "stddev");
+  for (int c=0; c<channels; c++) {
+    printf("%-16s %12d %12d %14.3f %14.3f\n", reader.name(c), low[c],
+           high[c], mean[c], n > 1 ? sqrt(squares[c] / (n - 1)) : 0.0);
+  }
+}
+
+/** ------------------------------------------------------------------------
+ * @brief csv function print samples with time (s) between "from" and "to".
+ */
+static void csv(TelemetryReader& reader, double from, double to) {
+  int channels = reader.channels();
+  printf("time");
+  for (int c=0; c<channels; c++) printf(",%s", reader.name(c));
+  printf("\n");
+  std::vector<const int32_t*> columns(channels);
+  for (int64_t k=0; k<reader.chunks(); k++) {
+    int rows = reader.load(k);
+    if (rows == 0) break;
+    const int64_t* times = reader.times();
+    if (times[rows-1] / 1e9 < from) continue;
+    if (times[0] / 1e9 > to) break;
+    for (int c=0; c<channels; c++) columns[c] = reader.column(c);
+    for (int i=0; i<rows; i++) {
+      double time = times[i] / 1e9;
+      if (time < from || time > to) continue;
+      printf("%.6f", time);
+      for (int c=0; c<channels; c++) printf(",%d", columns[c][i]);
+      printf("\n");
+    }
+  }
+}
+
+int main(int argCount, char* argValues[]) {
+  if (argCount < 2 || (argCount > 2 && strcmp(argValues[2], "csv") != 0)) {
+    fprintf(stderr, "usage: telemetry FILE [csv [FROM [TO]]]\n");
+    return 1;
+  }
+  TelemetryReader reader;
+  if (!reader.open(argValues[1])) {
+    fprintf(stderr, "%s: not a telemetry file\n", argValues[1]);
+    return 1;
+  }
+  if (argCount == 2) {
+    summary(reader);
+  }
+  else {
+    csv(reader, argCount > 3 ? atof(argValues[3]) : 0,
+        argCount > 4 ? atof(argValues[4]) : HUGE_VAL);
+  }
+  return 0;
+}
@@ -8,16 +8,25 @@
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QKeyEvent>
+#include <QFocusEvent>
 #include <QProgressBar>
 #include <QMenu>
 #include <QFile>
 #include <QThread>
+#include <QDateTime>
 
 #include <network.h>
 #include <idiom.h>
-
-#define len(x) sizeof(x)/sizeof(byte)
-#define non(x) (byte)-(x)
+#include <controller.h>
+#include <candidates.h>
+#include <steering.h>
+#include <recorder.h>
+#include <plot.h>
+#include <motors.h>
+#include <gamepad.h>
+#include <files.h>
+#include <melody.h>
+#include <shared.h>
 
 /** ========================================================================
  * @brief MyButton class overload to QPushButton due to, was necesary do
@@ -112,8 +121,13 @@ signals:
    */
   void scanPerformed(int);
   void connectPerformed(bool);
+  void racePerformed(QString);
 
 public:
+  QStringList candidates;   // devices tried to connect
+  QList<int>  latencies;    // outcome of each one (see Network::race)
+  int         deadline;     // ms to race connections
+
   /** ----------------------------------------------------------------------
    * @brief Thread constructor receive device combo and network references
    * to allow work with them.
@@ -139,11 +153,26 @@ public:
         emit scanPerformed(e);
       }
       break;
-    case 2:
+    case 2: {
+      candidates.clear();
+      candidates.append(devices->currentText());
+      qint64 start = monotonic();
       bool state = net->bind(devices->currentText().left(17));
+      latencies.clear();
+      latencies.append(state ? (monotonic() - start) / 1000000 : -1);
       emit connectPerformed(state);
       break;
     }
+    case 3: {
+      QStringList addresses;
+      foreach (QString candidate, candidates) {
+        addresses.append(candidate.left(17));
+      }
+      int winner = net->race(addresses, deadline, latencies);
+      emit racePerformed(winner >= 0 ? candidates[winner] : QString());
+      break;
+    }
+    }
   }
 };
 
@@ -167,6 +196,22 @@ private:
   QMenu         *recents,*selectidiom;
   Idiom         idiom;
   Thread        *t;
+  Controller    *controller;
+  ControllerPanel *panel;
+  Recorder      *recorder;
+  PlotPanel     *plots;
+  Candidates    candidates;
+  int           raceDeadline;
+  Steering      steering;
+  Motors        *motors;
+  Gamepad       *gamepad;
+  GamepadPanel  *pad;
+  Files         *files;
+  FilesPanel    *browser;
+  Melody        *melody;
+  MelodyPanel   *player;
+  SharedControl *shared;
+  SharedPanel   *sharing;
 
   /** ----------------------------------------------------------------------
    * @brief loadSettings method set de initial profiles to NXT PC Remote
@@ -176,17 +221,19 @@ private:
     QFile f(".nxt-pc-remote-control.cfg");
     f.open(QIODevice::ReadOnly);
     if (!f.isOpen()) {
-       idiom.setIdiomType(ENG);
        return;
     }
     QString data = f.readLine().data();
-    idiom.setIdiomType(data=="eng\n"?ENG:SPA);
+    idiom.setIdiom(data.trimmed());
     QString data2 = f.readLine();
     int recentsCount = data2.toInt();
     for (int i=0; i<recentsCount; i++) {
       data = f.readLine().data();
       recents->addAction(data);
     }
+    data = f.readLine().data();
+    if (data.toInt() > 0) raceDeadline = data.toInt();
+    sortRecents();
     refreshIdiom();
     f.close();
   }
@@ -209,31 +256,113 @@ private:
     QFile f(".nxt-pc-remote-control.cfg");
     f.open(QIODevice::WriteOnly);
     if (!f.isOpen()) return;
-    f.write( idiom.getIdiomType()==ENG?"eng\n":"spa\n" );
+    f.write( (idiom.getIdiom()+"\n").toStdString().c_str() );
     char size[4];
     sprintf( size,"%d\n", recents->actions().length() );
     f.write( size );
     foreach (QAction* action, recents->actions()) {
       f.write( action->text().toStdString().c_str() );
     }
+    sprintf( size,"%d\n", raceDeadline );
+    f.write( size );
     f.close();
   }
 
+  /** ----------------------------------------------------------------------
+   * @brief sortRecents method put best candidates at top of recents.
+   */
+  void sortRecents() {
+    QStringList texts;
+    foreach (QAction* action, recents->actions()) {
+      texts.append(action->text());
+    }
+    recents->clear();
+    foreach (QString text, candidates.order(texts)) {
+      recents->addAction(text);
+    }
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief waitConnection method disable GUI while a thread connects.
+   */
+  void waitConnection() {
+    info->setPixmap(QPixmap(":/images/clock.png"));
+    info->setEnabled(false);
+    bind->setEnabled(false);
+    scan->setEnabled(false);
+    devices->setEnabled(false);
+  }
+
   /** ----------------------------------------------------------------------
    * @brief refreshIdiom method update idiom of application.
    */
   void refreshIdiom() {
-    setWindowTitle(idiom.getWindowTitle());
-    scan->setText(idiom.getScanButtonLabel());
-    scan->isEnabled() ? bind->setText(idiom.getConnectButtonLabel()) :
-                        bind->setText(idiom.getDisconnectButtonLabel());
-    info->setPixmap(QPixmap(idiom.getImageInfo()));
-    selectidiom->actions().at(0)->setText(idiom.getMenuEnglish());
-    selectidiom->actions().at(1)->setText(idiom.getMenuSpanish());
-    menu->actions().at(0)->setText(idiom.getMenuRecentConnections());
-    menu->actions().at(1)->setText(idiom.getMenuClearConnections());
-    menu->actions().at(3)->setText(idiom.getMenuSelectIdiom());
-    menu->actions().at(5)->setText(idiom.getMenuAbout());
+    setWindowTitle(idiom.text(TXT_WINDOWTITLE));
+    scan->setText(idiom.text(TXT_SCANBUTTON));
+    scan->isEnabled() ? bind->setText(idiom.text(TXT_CONNECTBUTTON)) :
+                        bind->setText(idiom.text(TXT_DISCONNECTBUTTON));
+    info->setPixmap(QPixmap(idiom.text(TXT_IMAGEINFO)));
+    menu->actions().at(0)->setText(idiom.text(TXT_MENURECENTCONNECTIONS));
+    menu->actions().at(1)->setText(idiom.text(TXT_MENURACE));
+    menu->actions().at(2)->setText(idiom.text(TXT_MENUCLEARCONNECTIONS));
+    menu->actions().at(4)->setText(idiom.text(TXT_MENUSELECTIDIOM));
+    menu->actions().at(6)->setText(idiom.text(TXT_MENUCONTROLLER));
+    menu->actions().at(7)->setText(recorder->recording() ?
+                                   idiom.text(TXT_MENUSTOPRECORD) :
+                                   idiom.text(TXT_MENURECORD));
+    menu->actions().at(8)->setText(idiom.text(TXT_MENUPLOTS));
+    menu->actions().at(9)->setText(idiom.text(TXT_MENUGAMEPAD));
+    menu->actions().at(10)->setText(idiom.text(TXT_MENUFILES));
+    menu->actions().at(11)->setText(idiom.text(TXT_MENUMELODY));
+    menu->actions().at(12)->setText(idiom.text(TXT_MENUSHARED));
+    menu->actions().at(13)->setText(idiom.text(TXT_MENUABOUT));
+    panel->refreshIdiom();
+    plots->refreshIdiom();
+    pad->refreshIdiom();
+    browser->refreshIdiom();
+    player->refreshIdiom();
+    sharing->refreshIdiom();
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief recordTelemetry method start or stop the recording of sensors and
+   * motors, in a file named by date in current folder.
+   */
+  void recordTelemetry(bool on) {
+    if (on && net->connected() && !recorder->recording()) {
+      recorder->record("telemetry-" + QDateTime::currentDateTime()
+                       .toString("yyyyMMdd-hhmmss") + ".nxtt");
+    }
+    else if (!on) {
+      recorder->stopRecording();
+    }
+    menu->actions().at(7)->setText(recorder->recording() ?
+                                   idiom.text(TXT_MENUSTOPRECORD) :
+                                   idiom.text(TXT_MENURECORD));
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief level method return the power in use, high or low speed.
+   */
+  signed char level() {
+    return lowswitch ? powerlow : power;
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief drive method mix the keys held and update the motors.
+   */
+  void drive() {
+    signed char wanted[3];
+    steering.mix(level(), wanted);
+    motors->apply(wanted);
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief stopAll method forget keys held and stop the motors.
+   */
+  void stopAll() {
+    steering.clear();
+    drive();
   }
 
 public:
@@ -242,13 +371,14 @@ public:
    * @brief Window constructor launch application saving information in its
    * attribute, additionally, update GUI presentation.
    */
-  Window(): power(0x55), lowswitch(false), powerlow(0x3E) {
-    setWindowTitle(idiom.getWindowTitle());
+  Window(): power(0x55), lowswitch(false), powerlow(0x3E),
+            raceDeadline(8000) {
+    setWindowTitle(idiom.text(TXT_WINDOWTITLE));
     resize(250,100);
 
-    scan      = new MyButton(idiom.getScanButtonLabel());
+    scan      = new MyButton(idiom.text(TXT_SCANBUTTON));
     devices   = new QComboBox();
-    bind      = new MyButton(idiom.getConnectButtonLabel());
+    bind      = new MyButton(idiom.text(TXT_CONNECTBUTTON));
     info      = new MyLabel();
     lowspeed  = new QProgressBar();
     highspeed = new QProgressBar();
@@ -268,7 +398,7 @@ public:
 
     devices->setEnabled(false);
     bind->setEnabled(false);
-    info->setPixmap(QPixmap(idiom.getImageInfo()));
+    info->setPixmap(QPixmap(idiom.text(TXT_IMAGEINFO)));
     setStyleSheet("QFrame{background-color:white}");
     lowspeed->setMinimum(0x32);
     lowspeed->setMaximum(0x64);
@@ -278,19 +408,41 @@ public:
     highspeed->setValue(power);
 
     setFixedSize(278,438);
-    recents = new QMenu(idiom.getMenuRecentConnections());
-    selectidiom = new QMenu(idiom.getMenuSelectIdiom());
+    recents = new QMenu(idiom.text(TXT_MENURECENTCONNECTIONS));
+    selectidiom = new QMenu(idiom.text(TXT_MENUSELECTIDIOM));
     menu->addMenu(recents);
-    menu->addAction(idiom.getMenuClearConnections());
+    menu->addAction(idiom.text(TXT_MENURACE));
+    menu->addAction(idiom.text(TXT_MENUCLEARCONNECTIONS));
     menu->addSeparator();
     menu->addMenu(selectidiom);
     menu->addSeparator();
-    menu->addAction(idiom.getMenuAbout());
-    selectidiom->addAction(idiom.getMenuEnglish());
-    selectidiom->addAction(idiom.getMenuSpanish());
+    menu->addAction(idiom.text(TXT_MENUCONTROLLER));
+    menu->addAction(idiom.text(TXT_MENURECORD));
+    menu->addAction(idiom.text(TXT_MENUPLOTS));
+    menu->addAction(idiom.text(TXT_MENUGAMEPAD));
+    menu->addAction(idiom.text(TXT_MENUFILES));
+    menu->addAction(idiom.text(TXT_MENUMELODY));
+    menu->addAction(idiom.text(TXT_MENUSHARED));
+    menu->addAction(idiom.text(TXT_MENUABOUT));
+    foreach (QString code, Idiom::available()) {
+      selectidiom->addAction(Idiom::nativeName(code))->setData(code);
+    }
 
-    loadSettings();
     net = new Network();
+    controller = new Controller(net);
+    panel = new ControllerPanel(controller,&idiom);
+    recorder = new Recorder(net);
+    plots = new PlotPanel(recorder,&idiom);
+    motors = new Motors(net,controller);
+    gamepad = new Gamepad(motors);
+    pad = new GamepadPanel(gamepad,&idiom);
+    files = new Files(net);
+    browser = new FilesPanel(files,&idiom);
+    melody = new Melody(net);
+    player = new MelodyPanel(melody,&idiom);
+    shared = new SharedControl(net,motors,recorder);
+    sharing = new SharedPanel(shared,&idiom);
+    loadSettings();
 
     connect(scan,SIGNAL(clicked()),this,SLOT(scanDevices()));
     connect(bind,SIGNAL(clicked()),this,SLOT(connectDevice()));
@@ -306,9 +458,29 @@ public:
    */
   ~Window() {
     saveSettings();
+    delete sharing;
+    delete shared;
+    delete player;
+    delete melody;
+    delete browser;
+    delete files;
+    delete pad;
+    delete gamepad;
+    delete motors;
+    delete plots;
+    delete recorder;
+    delete panel;
+    delete controller;
     delete net;
   }
 
+  /** ----------------------------------------------------------------------
+   * @brief setCapture method record all traffic with brick (see capture.h)
+   */
+  void setCapture(Capture* capture) {
+    net->setCapture(capture);
+  }
+
 protected:
 
   /** ----------------------------------------------------------------------
@@ -316,78 +488,29 @@ protected:
    * Remote Control.
    */
   void keyPressEvent(QKeyEvent *event) {
-    if (bind->text() == idiom.connectButtonLabel) return;
+    if (bind->text() == idiom.text(TXT_CONNECTBUTTON)) return;
     if (!event->isAutoRepeat()) {
       switch (event->key()) {
 
         case Qt::Key_Alt: {
           lowswitch = true;
+          drive();
           break;
         }
 
         case Qt::Key_B: {
-          byte bytes[] = { 0x03, 0x0B, 0x02, 0xF4, 0x01 };
-          Telegram t;
-          t.append(bytes, len(bytes));
-          net->directCommand(t);
-          break;
-        }
-
-        case Qt::Key_Up : {
-          byte bytes3[] = { 0x04, 0x01, lowswitch?non(powerlow):non(power),
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes3, len(bytes3));
-
-          byte bytes4[] = { 0x04, 0x02, lowswitch?non(powerlow):non(power),
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes4, len(bytes4));
-          break;
-        }
-
-        case Qt::Key_Down : {
-          byte bytes3[] = { 0x04, 0x01, lowswitch?powerlow:power,
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes3, len(bytes3));
-
-          byte bytes4[] = { 0x04, 0x02, lowswitch?powerlow:power,
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes4, len(bytes4));
-          break;
-        }
-
-        case Qt::Key_Left : {
-          byte bytes3[] = { 0x04, 0x00, lowswitch?non(powerlow):non(power),
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes3, len(bytes3));
-
-//          byte bytes4[] = { 0x04, 0x02, lowswitch?powerlow:power,
-//                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-//          net->directCommand(bytes4, len(bytes4));
-          break;
-        }
-
-        case Qt::Key_Right : {
-          byte bytes3[] = { 0x04, 0x00, lowswitch?powerlow:power,
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes3, len(bytes3));
-
-//          byte bytes4[] = { 0x04, 0x02, lowswitch?non(powerlow):non(power),
-//                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-//          net->directCommand(bytes4, len(bytes4));
-          break;
-        }
-
-        case Qt::Key_N : {
-          byte bytes3[] = { 0x04, 0x00, lowswitch?powerlow:power,
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes3, len(bytes3));
+          net->directCommand(Telegram(PlayTone(0x020B,500)));
           break;
         }
 
+        case Qt::Key_Up :
+        case Qt::Key_Down :
+        case Qt::Key_Left :
+        case Qt::Key_Right :
+        case Qt::Key_N :
         case Qt::Key_M : {
-          byte bytes3[] = { 0x04, 0x00, lowswitch?non(powerlow):non(power),
-                            0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
-          net->directCommand(bytes3, len(bytes3));
+          steering.press(event->key());
+          drive();
           break;
         }
 
@@ -445,6 +568,9 @@ protected:
         }
       }
     }
+    if (event->key() == Qt::Key_Minus || event->key() == Qt::Key_Plus) {
+      drive();
+    }
   }
 
   /** ----------------------------------------------------------------------
@@ -452,7 +578,7 @@ protected:
    * Remote Control.
    */
   void keyReleaseEvent(QKeyEvent *event) {
-    if (bind->text() == idiom.getConnectButtonLabel()) return;
+    if (bind->text() == idiom.text(TXT_CONNECTBUTTON)) return;
     if (!event->isAutoRepeat()) {
       switch (event->key()) {
         case Qt::Key_Up:
@@ -461,22 +587,14 @@ protected:
         case Qt::Key_Right:
         case Qt::Key_N:
         case Qt::Key_M: {
-          byte bytes0[] = { 0x04, 0x00, power, 0x02, 0x01, 0x00, 0x20, 0x00,
-                            0x00, 0x00, 0x00 };
-          net->directCommand(bytes0, len(bytes0));
-
-          byte bytes1[] = { 0x04, 0x01, power, 0x02, 0x01, 0x00, 0x20, 0x00,
-                            0x00, 0x00, 0x00 };
-          net->directCommand(bytes1, len(bytes1));
-
-          byte bytes2[] = { 0x04, 0x02, power, 0x02, 0x01, 0x00, 0x20, 0x00,
-                            0x00, 0x00, 0x00 };
-          net->directCommand(bytes2, len(bytes2));
+          steering.release(event->key());
+          drive();
           break;
         }
 
         case Qt::Key_Alt: {
           lowswitch = false;
+          drive();
           break;
         }
 
@@ -484,6 +602,15 @@ protected:
     }
   }
 
+  /** ----------------------------------------------------------------------
+   * @brief focusOutEvent stop robot, releases of keys held will not arrive
+   * to this window.
+   */
+  void focusOutEvent(QFocusEvent *event) {
+    if (net->connected()) stopAll();
+    QFrame::focusOutEvent(event);
+  }
+
 public slots:
 
   /** ----------------------------------------------------------------------
@@ -495,7 +622,7 @@ public slots:
     devices->setEnabled(false);
     bind->setEnabled(false);
     scan->setEnabled(false);
-    devices->addItem(idiom.getMessageSearching());
+    devices->addItem(idiom.text(TXT_MESSAGESEARCHING));
     info->setPixmap(QPixmap(":/images/clock.png"));
     info->setEnabled(false);
 
@@ -508,11 +635,11 @@ public slots:
    * @brief scanPerformed is run after net scan->
    */
   void scanPerformed(int throwstate) {
-    info->setPixmap(QPixmap(idiom.getImageInfo()));
+    info->setPixmap(QPixmap(idiom.text(TXT_IMAGEINFO)));
     info->setEnabled(true);
     devices->setEnabled(true);
     scan->setEnabled(true);
-    info->setPixmap(QPixmap(idiom.getImageInfo()));
+    info->setPixmap(QPixmap(idiom.text(TXT_IMAGEINFO)));
     if (throwstate==0) {
       bind->setEnabled(true);
     }
@@ -520,11 +647,11 @@ public slots:
       bind->setEnabled(false);
       switch(throwstate) {
         case 1: {
-          devices->addItem(idiom.getMessageBluetoothDisabled());
+          devices->addItem(idiom.text(TXT_MESSAGEBLUETOOTHDISABLED));
           break;
         }
         case 2: {
-          devices->addItem(idiom.getMessageNearDivices());
+          devices->addItem(idiom.text(TXT_MESSAGENEARDEVICES));
           break;
         }
       }
@@ -536,23 +663,28 @@ public slots:
    * @brief connectDevice bind NXT PC Remote Control with a wanted device
    */
   void connectDevice() {
-    if (bind->text() == idiom.getConnectButtonLabel()) {
-      info->setPixmap(QPixmap(":/images/clock.png"));
-      info->setEnabled(false);
-      bind->setEnabled(false);
-      scan->setEnabled(false);
-      devices->setEnabled(false);
+    if (bind->text() == idiom.text(TXT_CONNECTBUTTON)) {
+      waitConnection();
       t = new Thread(devices,net,2);
       connect(t,SIGNAL(connectPerformed(bool)),this,SLOT(connectPerformed(bool)));
       t->start();
     }
     else {
+      gamepad->setAttached(false);
+      shared->setAttached(false);
+      browser->hide();
+      files->reset();
+      melody->setAttached(false);
+      stopAll();
+      recorder->setAttached(false);
+      recordTelemetry(false);
+      controller->setAttached(false);
       net->unbind();
       scan->setEnabled(true);
       devices->setEnabled(true);
-      bind->setText(idiom.getConnectButtonLabel());
+      bind->setText(idiom.text(TXT_CONNECTBUTTON));
       recents->setEnabled(true);
-      for (int i=0; i<4;i++) menu->actions().at(i)->setEnabled(true);
+      for (int i=0; i<5;i++) menu->actions().at(i)->setEnabled(true);
     }
   }
 
@@ -560,23 +692,63 @@ public slots:
    * @brief connectPerfomred is run after net bind function.
    */
   void connectPerformed(bool ok) {
-    info->setPixmap(QPixmap(idiom.getImageInfo()));
+    info->setPixmap(QPixmap(idiom.text(TXT_IMAGEINFO)));
     info->setEnabled(true);
+    for (int i=0; i<t->latencies.size(); i++) {
+      candidates.record(t->candidates[i].left(17), t->latencies[i]);
+    }
+    candidates.save();
     if (ok) {
-      bind->setText(idiom.getDisconnectButtonLabel());
+      bind->setText(idiom.text(TXT_DISCONNECTBUTTON));
       addRecent(devices->currentText());
-      for (int i=0; i<4;i++) menu->actions().at(i)->setEnabled(false);
+      sortRecents();
+      controller->setAttached(true);
+      recorder->setAttached(true);
+      gamepad->setAttached(true);
+      melody->setAttached(true);
+      shared->setAttached(true);
+      for (int i=0; i<5;i++) menu->actions().at(i)->setEnabled(false);
     }
     else {
       scan->setEnabled(true);
       devices->clear();
-      devices->addItem(idiom.getMessageDeviceAvailable());
+      devices->addItem(idiom.text(TXT_MESSAGEDEVICEAVAILABLE));
       devices->setEnabled(true);
     }
     bind->setEnabled(true);
     delete t;
   }
 
+  /** ----------------------------------------------------------------------
+   * @brief racePerformed is run after net race function, with the winner
+   * device (empty when nobody answered).
+   */
+  void racePerformed(QString winner) {
+    devices->clear();
+    devices->addItem(winner);
+    connectPerformed(!winner.isEmpty());
+  }
+
+  /** ----------------------------------------------------------------------
+   * @brief raceRecents method connect with the first recent device that
+   * answers, trying all of them at same time.
+   */
+  void raceRecents() {
+    QStringList texts;
+    foreach (QAction* action, recents->actions()) {
+      texts.append(action->text().left(action->text().size()-1));
+    }
+    if (texts.isEmpty()) return;
+    waitConnection();
+    devices->clear();
+    devices->addItem(idiom.text(TXT_MESSAGESEARCHING));
+    t = new Thread(devices,net,3);
+    t->candidates = candidates.order(texts);
+    t->deadline = raceDeadline;
+    connect(t,SIGNAL(racePerformed(QString)),this,SLOT(racePerformed(QString)));
+    t->start();
+  }
+
   /** ----------------------------------------------------------------------
    * @brief popMenu method show a flotating menu with some additional
    * options.
@@ -590,30 +762,21 @@ public slots:
    * method is exec when an user use the cache connections.
    */
   void recentSelection(QAction* action) {
-    info->setPixmap(QPixmap(":/images/clock.png"));
-    info->setEnabled(false);
-    bind->setEnabled(false);
-    scan->setEnabled(false);
+    waitConnection();
     devices->clear();
     devices->addItem(action->text().left(action->text().size()-1));
-    devices->setEnabled(false);
     t = new Thread(devices,net,2);
     connect(t,SIGNAL(connectPerformed(bool)),this,SLOT(connectPerformed(bool)));
     t->start();
   }
 
   /** ----------------------------------------------------------------------
-   * @brief changeIdiom method switch de interface language between Englis
-   * and Spanish
+   * @brief changeIdiom method switch de interface language to the idiom
+   * kept in the selected action.
    */
   void changeIdiom(QAction *action) {
-     if (action->text().left(3)==idiom.getMenuEnglish().left(3) && idiom.getIdiomType()!=ENG) {
-       idiom.setIdiomType(ENG);
-       refreshIdiom();
-     }
-     else if (action->text().left(3)==idiom.getMenuSpanish().left(3) &&
-              idiom.getIdiomType()!=SPA) {
-       idiom.setIdiomType(SPA);
+     QString code = action->data().toString();
+     if (code != idiom.getIdiom() && idiom.setIdiom(code)) {
        refreshIdiom();
      }
   }
@@ -623,12 +786,46 @@ public slots:
    * and Clear cache connections
    */
   void menuOption(QAction* action) {
-    if (action->text()==idiom.getMenuAbout()) {
+    if (action->text()==idiom.text(TXT_MENUABOUT)) {
       showAbout(true);
     }
-    else if (action->text()==idiom.getMenuClearConnections()) {
+    else if (action->text()==idiom.text(TXT_MENUCLEARCONNECTIONS)) {
       recents->clear();
     }
+    else if (action->text()==idiom.text(TXT_MENURACE)) {
+      raceRecents();
+    }
+    else if (action->text()==idiom.text(TXT_MENUCONTROLLER)) {
+      panel->show();
+      panel->raise();
+    }
+    else if (action->text()==idiom.text(TXT_MENUPLOTS)) {
+      plots->show();
+      plots->raise();
+    }
+    else if (action->text()==idiom.text(TXT_MENUFILES)) {
+      if (!net->connected()) return;
+      browser->show();
+      browser->raise();
+    }
+    else if (action->text()==idiom.text(TXT_MENUGAMEPAD)) {
+      pad->show();
+      pad->raise();
+    }
+    else if (action->text()==idiom.text(TXT_MENUMELODY)) {
+      player->show();
+      player->raise();
+    }
+    else if (action->text()==idiom.text(TXT_MENUSHARED)) {
+      sharing->show();
+      sharing->raise();
+    }
+    else if (action->text()==idiom.text(TXT_MENURECORD)) {
+      recordTelemetry(true);
+    }
+    else if (action->text()==idiom.text(TXT_MENUSTOPRECORD)) {
+      recordTelemetry(false);
+    }
   }
 
   /** ----------------------------------------------------------------------
@@ -639,7 +836,7 @@ public slots:
       info->setPixmap(QPixmap(":/images/about.png"));
     }
     else {
-      info->setPixmap(QPixmap(idiom.getImageInfo()));
+      info->setPixmap(QPixmap(idiom.text(TXT_IMAGEINFO)));
     }
   }
 